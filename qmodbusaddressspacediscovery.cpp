@@ -0,0 +1,426 @@
+#include "qmodbusaddressspacediscovery.h"
+#include <QDebug>
+
+// QModbusAddressRange :
+QModbusAddressRange::QModbusAddressRange()
+{
+    this->startAddress = 0;
+    this->count = 0;
+}
+
+QModbusAddressRange::QModbusAddressRange(quint16 startAddress, quint32 count)
+{
+    this->startAddress = startAddress;
+    this->count = count;
+}
+
+quint32 QModbusAddressRange::getEndAddress() const
+{
+    return (quint32)startAddress + count;
+}
+
+// QModbusAddressSpaceMap :
+QModbusAddressSpaceMap::QModbusAddressSpaceMap(quint8 functionCode)
+{
+    this->functionCode = functionCode;
+    this->maxBlockSize = 0;
+}
+
+quint8 QModbusAddressSpaceMap::getFunctionCode() const
+{
+    return functionCode;
+}
+
+quint16 QModbusAddressSpaceMap::getMaxBlockSize() const
+{
+    return maxBlockSize;
+}
+
+void QModbusAddressSpaceMap::setMaxBlockSize(quint16 maxBlockSize)
+{
+    this->maxBlockSize = maxBlockSize;
+}
+
+QVector<QModbusAddressRange> QModbusAddressSpaceMap::getReadableRanges() const
+{
+    return readableRanges;
+}
+
+void QModbusAddressSpaceMap::addReadableRange(quint16 startAddress, quint32 count)
+{
+    quint32 start = startAddress;
+    quint32 end = start + count;
+
+    // The read crossed these boundaries :
+    for(int i = boundaries.size() - 1; i >= 0; i--)
+    {
+        if(boundaries[i] > start && boundaries[i] < end)
+        {
+            boundaries.remove(i);
+        }
+    }
+
+    // Absorb every range overlapping the new one, or touching it away from a boundary :
+    int idx = 0;
+    while(idx < readableRanges.size()
+          && (readableRanges[idx].getEndAddress() < start || (readableRanges[idx].getEndAddress() == start && isBoundary(start))))
+    {
+        idx++;
+    }
+
+    while(idx < readableRanges.size()
+          && (readableRanges[idx].startAddress < end || (readableRanges[idx].startAddress == end && !isBoundary(end))))
+    {
+        start = qMin<quint32>(start, readableRanges[idx].startAddress);
+        end = qMax<quint32>(end, readableRanges[idx].getEndAddress());
+        readableRanges.remove(idx);
+    }
+
+    readableRanges.insert(idx, QModbusAddressRange(start, end - start));
+}
+
+QVector<quint32> QModbusAddressSpaceMap::getBoundaries() const
+{
+    return boundaries;
+}
+
+bool QModbusAddressSpaceMap::isBoundary(quint32 address) const
+{
+    return boundaries.contains(address);
+}
+
+void QModbusAddressSpaceMap::addBoundary(quint32 address)
+{
+    int idx = 0;
+    while(idx < boundaries.size() && boundaries[idx] < address)
+    {
+        idx++;
+    }
+
+    if(idx == boundaries.size() || boundaries[idx] != address)
+    {
+        boundaries.insert(idx, address);
+    }
+}
+
+int QModbusAddressSpaceMap::findReadableRange(quint32 startAddress, quint32 count) const
+{
+    for(int i = 0; i < readableRanges.size(); i++)
+    {
+        if(readableRanges[i].startAddress <= startAddress && startAddress + count <= readableRanges[i].getEndAddress())
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+quint16 QModbusAddressSpaceMap::getProtocolMaxBlockSize(quint8 functionCode)
+{
+    switch(functionCode)
+    {
+    case 0x01:
+    case 0x02:
+        return 2000;
+    case 0x03:
+    case 0x04:
+        return 125;
+    default:
+        return 0;
+    }
+}
+
+// QModbusAddressSpaceDiscovery :
+QModbusAddressSpaceDiscovery::QModbusAddressSpaceDiscovery(QModbusTcpClient * client, QObject *parent) : QObject(parent)
+{
+    this->client = client;
+    this->functionCode = 0x03;
+    this->responseTimeout = 1000;
+    this->probeTransactionId = 0;
+    this->running = false;
+    this->phase = ProbingRanges;
+    this->probeCount = 0;
+    this->measureAddress = 0;
+    this->blockSizeUpperBound = 0;
+
+    timeoutTimer.setSingleShot(true);
+
+    QObject::connect(client, SIGNAL(onReadMultipleHoldingRegistersSentence(quint16, QVector<quint16>)), this, SLOT(onReadMultipleHoldingRegistersSentence(quint16, QVector<quint16>)));
+    QObject::connect(client, SIGNAL(onReadMultipleInputRegistersSentence(quint16, QVector<quint16>)), this, SLOT(onReadMultipleInputRegistersSentence(quint16, QVector<quint16>)));
+    QObject::connect(client, SIGNAL(onReadMultipleInputsStatusSentence(quint16, QVector<bool>)), this, SLOT(onReadMultipleInputsStatusSentence(quint16, QVector<bool>)));
+    QObject::connect(client, SIGNAL(onRequestAborted(quint16, quint8, quint16)), this, SLOT(onRequestAborted(quint16, quint8, quint16)));
+    QObject::connect(client, SIGNAL(onModbusException(quint16, quint8, quint16, QModbusTcpClient::ExceptionCode)), this, SLOT(onModbusException(quint16, quint8, quint16, QModbusTcpClient::ExceptionCode)));
+    QObject::connect(client, SIGNAL(onRequestSent(quint16)), this, SLOT(onRequestSent(quint16)));
+    QObject::connect(client, SIGNAL(disconnected()), this, SLOT(onClientDisconnected()));
+    QObject::connect(client, SIGNAL(onSendHold(int)), this, SLOT(onSendHold(int)));
+    QObject::connect(&timeoutTimer, SIGNAL(timeout()), this, SLOT(onResponseTimeout()));
+}
+
+void QModbusAddressSpaceDiscovery::setResponseTimeout(int timeoutMs)
+{
+    responseTimeout = timeoutMs;
+}
+
+void QModbusAddressSpaceDiscovery::start(quint8 functionCode, quint16 startAddress, quint32 count)
+{
+    quint16 protocolMaxBlockSize = QModbusAddressSpaceMap::getProtocolMaxBlockSize(functionCode);
+    if(functionCode == 0x01 || protocolMaxBlockSize == 0)
+    {
+        qDebug() << "QModbusAddressSpaceDiscovery::start - Unsupported function code ... Operation aborted.";
+        return;
+    }
+
+    this->functionCode = functionCode;
+    map = QModbusAddressSpaceMap(functionCode);
+    rangesToProbe.clear();
+    probeCount = 0;
+
+    count = qMin<quint32>(count, 0x10000 - startAddress);
+    for(quint32 offset = 0; offset < count; offset += protocolMaxBlockSize)
+    {
+        rangesToProbe.push_back(QModbusAddressRange(startAddress + offset, qMin<quint32>(protocolMaxBlockSize, count - offset)));
+    }
+
+    running = true;
+    phase = ProbingRanges;
+    probeNext();
+}
+
+bool QModbusAddressSpaceDiscovery::isRunning()
+{
+    return running;
+}
+
+quint32 QModbusAddressSpaceDiscovery::getProbeCount()
+{
+    return probeCount;
+}
+
+QModbusAddressSpaceMap QModbusAddressSpaceDiscovery::getMap()
+{
+    return map;
+}
+
+void QModbusAddressSpaceDiscovery::probeNext()
+{
+    if(phase == ProbingRanges && rangesToProbe.isEmpty())
+    {
+        startJoining();
+    }
+
+    if(phase == JoiningRanges && rangesToProbe.isEmpty())
+    {
+        startMeasuring();
+    }
+
+    if(phase == MeasuringBlockSize)
+    {
+        quint32 lowerBound = map.getMaxBlockSize();
+        if(lowerBound >= blockSizeUpperBound)
+        {
+            running = false;
+            emit onDiscoveryFinished(map);
+            return;
+        }
+
+        currentProbe = QModbusAddressRange(measureAddress, (lowerBound + blockSizeUpperBound + 1) / 2);
+    }
+    else
+    {
+        currentProbe = rangesToProbe.takeFirst();
+    }
+
+    probeCount++;
+    sendProbe();
+}
+
+void QModbusAddressSpaceDiscovery::startJoining()
+{
+    phase = JoiningRanges;
+
+    // A split point only bounds the ranges if no read across it succeeds, try the smallest one :
+    QVector<quint32> boundaries = map.getBoundaries();
+    for(int i = 0; i < boundaries.size(); i++)
+    {
+        quint32 boundary = boundaries[i];
+        if(boundary > 0 && map.findReadableRange(boundary - 1, 1) >= 0 && map.findReadableRange(boundary, 1) >= 0)
+        {
+            rangesToProbe.push_back(QModbusAddressRange(boundary - 1, 2));
+        }
+    }
+}
+
+void QModbusAddressSpaceDiscovery::startMeasuring()
+{
+    phase = MeasuringBlockSize;
+
+    // The largest accepted probe only bounds the limit from below, search it inside the largest readable range :
+    QVector<QModbusAddressRange> ranges = map.getReadableRanges();
+    blockSizeUpperBound = 0;
+    for(int i = 0; i < ranges.size(); i++)
+    {
+        if(ranges[i].count > blockSizeUpperBound)
+        {
+            blockSizeUpperBound = ranges[i].count;
+            measureAddress = ranges[i].startAddress;
+        }
+    }
+
+    blockSizeUpperBound = qMin<quint32>(blockSizeUpperBound, QModbusAddressSpaceMap::getProtocolMaxBlockSize(functionCode));
+}
+
+void QModbusAddressSpaceDiscovery::sendProbe()
+{
+    // The timeout is started by onRequestSent, once the client actually writes the probe :
+    switch(functionCode)
+    {
+    case 0x02:
+        probeTransactionId = client->readMultipleInputsStatusFC2(currentProbe.startAddress, currentProbe.count);
+        break;
+    case 0x03:
+        probeTransactionId = client->readMultipleHoldingRegistersFC3(currentProbe.startAddress, currentProbe.count);
+        break;
+    case 0x04:
+        probeTransactionId = client->readMultipleInputRegistersFC4(currentProbe.startAddress, currentProbe.count);
+        break;
+    }
+}
+
+void QModbusAddressSpaceDiscovery::onRequestSent(quint16 transactionId)
+{
+    if(running && transactionId == probeTransactionId && responseTimeout > 0)
+    {
+        timeoutTimer.start(responseTimeout);
+    }
+}
+
+void QModbusAddressSpaceDiscovery::onSendHold(int delayMs)
+{
+    // A busy device may also be slow to answer the probe already sent, give it the hold period too :
+    if(timeoutTimer.isActive())
+    {
+        timeoutTimer.start(timeoutTimer.remainingTime() + delayMs);
+    }
+}
+
+void QModbusAddressSpaceDiscovery::onClientDisconnected()
+{
+    // The probe is replayed or aborted by the client, it isn't judged meanwhile :
+    timeoutTimer.stop();
+}
+
+void QModbusAddressSpaceDiscovery::onProbeResult(bool readable)
+{
+    timeoutTimer.stop();
+    probeTransactionId = 0;
+
+    if(phase == MeasuringBlockSize)
+    {
+        if(readable)
+        {
+            map.setMaxBlockSize(currentProbe.count);
+        }
+        else
+        {
+            blockSizeUpperBound = currentProbe.count - 1;
+        }
+    }
+    else if(readable)
+    {
+        map.addReadableRange(currentProbe.startAddress, currentProbe.count);
+        if(currentProbe.count > map.getMaxBlockSize())
+        {
+            map.setMaxBlockSize(currentProbe.count);
+        }
+    }
+    else if(phase == ProbingRanges && currentProbe.count > 1)
+    {
+        // Split the rejected block, the lower half is probed first so ranges are found in address order.
+        // No read across the split point was accepted, it stays a boundary until one is :
+        quint32 lowerCount = currentProbe.count / 2;
+        map.addBoundary(currentProbe.startAddress + lowerCount);
+        rangesToProbe.insert(0, QModbusAddressRange(currentProbe.startAddress + lowerCount, currentProbe.count - lowerCount));
+        rangesToProbe.insert(0, QModbusAddressRange(currentProbe.startAddress, lowerCount));
+    }
+
+    probeNext();
+}
+
+void QModbusAddressSpaceDiscovery::onReadMultipleHoldingRegistersSentence(quint16 startAddress, QVector<quint16> values)
+{
+    Q_UNUSED(startAddress);
+
+    if(running && client->getRespondingTransactionId() == probeTransactionId)
+    {
+        onProbeResult((quint32)values.size() == currentProbe.count);
+    }
+}
+
+void QModbusAddressSpaceDiscovery::onReadMultipleInputRegistersSentence(quint16 startAddress, QVector<quint16> values)
+{
+    Q_UNUSED(startAddress);
+
+    if(running && client->getRespondingTransactionId() == probeTransactionId)
+    {
+        onProbeResult((quint32)values.size() == currentProbe.count);
+    }
+}
+
+void QModbusAddressSpaceDiscovery::onReadMultipleInputsStatusSentence(quint16 startAddress, QVector<bool> values)
+{
+    Q_UNUSED(startAddress);
+
+    if(running && client->getRespondingTransactionId() == probeTransactionId)
+    {
+        onProbeResult((quint32)values.size() == currentProbe.count);
+    }
+}
+
+void QModbusAddressSpaceDiscovery::onRequestAborted(quint16 transactionId, quint8 functionCode, quint16 address)
+{
+    Q_UNUSED(functionCode);
+    Q_UNUSED(address);
+
+    if(running && transactionId == probeTransactionId)
+    {
+        // The connection was lost, probe the same block again once the client sends it :
+        timeoutTimer.stop();
+        sendProbe();
+    }
+}
+
+void QModbusAddressSpaceDiscovery::onModbusException(quint16 transactionId, quint8 functionCode, quint16 address, QModbusTcpClient::ExceptionCode exceptionCode)
+{
+    Q_UNUSED(functionCode);
+    Q_UNUSED(address);
+
+    if(!running || transactionId != probeTransactionId)
+    {
+        return;
+    }
+
+    if(exceptionCode == QModbusTcpClient::SlaveDeviceBusy
+            || exceptionCode == QModbusTcpClient::GatewayPathUnavailable
+            || exceptionCode == QModbusTcpClient::GatewayTargetFailedToRespond)
+    {
+        // Says nothing about the address space. The client holds the retry until the device recovers,
+        // and the timeout only starts once the retry is written :
+        timeoutTimer.stop();
+        sendProbe();
+    }
+    else
+    {
+        onProbeResult(false);
+    }
+}
+
+void QModbusAddressSpaceDiscovery::onResponseTimeout()
+{
+    if(running)
+    {
+        // Nobody waits for this probe anymore, it must neither be replayed nor answered late :
+        client->cancelRequest(probeTransactionId);
+        onProbeResult(false);
+    }
+}
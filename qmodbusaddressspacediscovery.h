@@ -0,0 +1,115 @@
+#ifndef QModbusAddressSpaceDiscovery_H
+#define QModbusAddressSpaceDiscovery_H
+
+#include <QObject>
+#include <QList>
+#include <QVector>
+#include <QTimer>
+#include "qmodbustcpclient.h"
+
+class QModbusAddressRange
+{
+public:
+    quint16 startAddress;
+    quint32 count;
+
+    QModbusAddressRange();
+    QModbusAddressRange(quint16 startAddress, quint32 count);
+    quint32 getEndAddress() const; // Exclusive
+};
+
+// Readable ranges of one table (FC2, FC3 or FC4) of a device :
+class QModbusAddressSpaceMap
+{
+    quint8 functionCode;
+    quint16 maxBlockSize;
+    QVector<QModbusAddressRange> readableRanges; // Sorted and merged
+    QVector<quint32> boundaries; // Sorted addresses no accepted read crosses, touching ranges aren't merged there
+
+public:
+    QModbusAddressSpaceMap(quint8 functionCode = 0x03);
+
+    quint8 getFunctionCode() const;
+    quint16 getMaxBlockSize() const;
+    void setMaxBlockSize(quint16 maxBlockSize);
+    QVector<QModbusAddressRange> getReadableRanges() const;
+    // A successful read of the whole span, which removes the boundaries it crosses :
+    void addReadableRange(quint16 startAddress, quint32 count);
+
+    QVector<quint32> getBoundaries() const;
+    bool isBoundary(quint32 address) const;
+    void addBoundary(quint32 address);
+
+    // Index of the readable range holding the whole [startAddress, startAddress + count[ span, -1 if none :
+    int findReadableRange(quint32 startAddress, quint32 count) const;
+
+    // Largest number of values a single request of this function code may read according to the spec :
+    static quint16 getProtocolMaxBlockSize(quint8 functionCode);
+};
+
+// Probe the address space of a device by binary-splitting every read rejected by the device.
+// The split point of a rejected read is kept as a boundary until a 2 values read across it succeeds,
+// then the largest request the device accepts is measured by a binary search on the count inside
+// the largest readable range.
+// Probes are sent one at a time and matched on their transaction id : a probe answered by an
+// exception, or without response before the timeout, is considered rejected and cancelled.
+// The timeout only runs while the probe is actually on the wire and is extended by any send hold
+// of the client. Busy and gateway exceptions make the same probe be sent again after the hold.
+class QModbusAddressSpaceDiscovery : public QObject
+{
+    Q_OBJECT
+
+    enum Phase {
+        ProbingRanges,
+        JoiningRanges,
+        MeasuringBlockSize
+    };
+
+    QModbusTcpClient * client;
+    quint8 functionCode;
+    int responseTimeout;
+    QModbusAddressSpaceMap map;
+
+    QList<QModbusAddressRange> rangesToProbe;
+    QModbusAddressRange currentProbe;
+    quint16 probeTransactionId;
+    bool running;
+    Phase phase;
+    quint32 probeCount;
+    quint16 measureAddress;
+    quint32 blockSizeUpperBound;
+    QTimer timeoutTimer;
+
+    void probeNext();
+    void sendProbe();
+    void startJoining();
+    void startMeasuring();
+    void onProbeResult(bool readable);
+
+public:
+    explicit QModbusAddressSpaceDiscovery(QModbusTcpClient * client, QObject *parent = nullptr);
+
+    void setResponseTimeout(int timeoutMs);
+
+    // functionCode is 0x02, 0x03 or 0x04 :
+    void start(quint8 functionCode, quint16 startAddress = 0, quint32 count = 0x10000);
+    bool isRunning();
+    quint32 getProbeCount();
+    QModbusAddressSpaceMap getMap();
+
+signals:
+    void onDiscoveryFinished(QModbusAddressSpaceMap map);
+
+private slots:
+    void onReadMultipleHoldingRegistersSentence(quint16 startAddress, QVector<quint16> values);
+    void onReadMultipleInputRegistersSentence(quint16 startAddress, QVector<quint16> values);
+    void onReadMultipleInputsStatusSentence(quint16 startAddress, QVector<bool> values);
+    void onRequestAborted(quint16 transactionId, quint8 functionCode, quint16 address);
+    void onModbusException(quint16 transactionId, quint8 functionCode, quint16 address, QModbusTcpClient::ExceptionCode exceptionCode);
+    void onRequestSent(quint16 transactionId);
+    void onSendHold(int delayMs);
+    void onClientDisconnected();
+    void onResponseTimeout();
+};
+
+#endif // QModbusAddressSpaceDiscovery_H
@@ -0,0 +1,917 @@
+#include "qmodbuscompactfleet.h"
+#include "qmodbusframe.h"
+#include <QDebug>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+QModbusCompactFleet::QModbusCompactFleet(QObject *parent) : QObject(parent)
+{
+    this->borrowedBufferCount = 0;
+
+    this->autoReconnect = false;
+    this->reconnectInitialDelay = 100;
+    this->reconnectMaxDelay = 5000;
+    this->connectTimeout = 2000;
+    this->responseTimeout = 5000;
+    this->deviceTimerDue = 0;
+
+    resetExceptionCounters();
+    this->exceptionBackoffInitialDelay = 50;
+    this->exceptionBackoffMaxDelay = 2000;
+
+    clock.start();
+    deviceTimer.setSingleShot(true);
+
+    QObject::connect(&deviceTimer, SIGNAL(timeout()), this, SLOT(onDeviceTimeout()));
+    QObject::connect(&idleCheckTimer, SIGNAL(timeout()), this, SLOT(onIdleCheckTimeout()));
+    idleCheckTimer.start(5000);
+}
+
+QModbusCompactFleet::~QModbusCompactFleet()
+{
+    for(int i = 0; i < devices.size(); i++)
+    {
+        if(devices[i].socket >= 0)
+        {
+            ::close(devices[i].socket);
+        }
+        delete[] devices[i].buffer;
+    }
+
+    for(int i = 0; i < bufferPool.size(); i++)
+    {
+        delete[] bufferPool[i];
+    }
+}
+
+int QModbusCompactFleet::addDevice(QHostAddress address, quint16 port, quint8 unitId)
+{
+    bool isIPv4 = false;
+    quint32 ipv4Address = address.toIPv4Address(&isIPv4);
+    if(!isIPv4)
+    {
+        qDebug() << "QModbusCompactFleet::addDevice - Only IPv4 addresses are supported ... Operation aborted.";
+        return -1;
+    }
+
+    Device device;
+    memset(&device, 0, sizeof(device));
+    device.ipv4Address = ipv4Address;
+    device.port = port;
+    device.unitId = unitId;
+    device.state = Disconnected;
+    device.transactionId = 1;
+    device.socket = -1;
+    device.backoffStep = 0;
+    device.flags = 0;
+    device.buffer = nullptr;
+    device.notifier = nullptr;
+
+    devices.push_back(device);
+    return devices.size() - 1;
+}
+
+int QModbusCompactFleet::getDeviceCount()
+{
+    return devices.size();
+}
+
+QModbusCompactFleet::DeviceState QModbusCompactFleet::getDeviceState(int device)
+{
+    Device * d = getDevice(device);
+    return d == nullptr ? Disconnected : (DeviceState)d->state;
+}
+
+int QModbusCompactFleet::getDeviceStateSize()
+{
+    return sizeof(Device);
+}
+
+int QModbusCompactFleet::getBorrowedBufferCount()
+{
+    return borrowedBufferCount;
+}
+
+int QModbusCompactFleet::getPooledBufferCount()
+{
+    return bufferPool.size();
+}
+
+QModbusCompactFleet::Device * QModbusCompactFleet::getDevice(int device)
+{
+    if(device < 0 || device >= devices.size())
+    {
+        return nullptr;
+    }
+    return &devices[device];
+}
+
+quint32 QModbusCompactFleet::getTime()
+{
+    // Device times wrap after 49 days, they are only compared through a signed difference :
+    return (quint32)clock.elapsed();
+}
+
+void QModbusCompactFleet::setAutoReconnect(bool enabled)
+{
+    autoReconnect = enabled;
+    if(!enabled)
+    {
+        for(int i = 0; i < devices.size(); i++)
+        {
+            if(devices[i].state == Disconnected)
+            {
+                devices[i].flags &= ~TimerArmed;
+            }
+        }
+    }
+}
+
+void QModbusCompactFleet::setReconnectBackoff(int initialDelayMs, int maxDelayMs)
+{
+    reconnectInitialDelay = qMax(1, initialDelayMs);
+    reconnectMaxDelay = qMax(reconnectInitialDelay, maxDelayMs);
+}
+
+void QModbusCompactFleet::setConnectTimeout(int timeoutMs)
+{
+    connectTimeout = timeoutMs;
+}
+
+void QModbusCompactFleet::setResponseTimeout(int timeoutMs)
+{
+    responseTimeout = timeoutMs;
+}
+
+void QModbusCompactFleet::setIdleCheckInterval(int intervalMs)
+{
+    if(intervalMs > 0)
+    {
+        idleCheckTimer.start(intervalMs);
+    }
+    else
+    {
+        idleCheckTimer.stop();
+    }
+}
+
+quint32 QModbusCompactFleet::getExceptionCount(QModbusTcpClient::ExceptionCode exceptionCode)
+{
+    return exceptionCounters[exceptionCode];
+}
+
+void QModbusCompactFleet::resetExceptionCounters()
+{
+    for(int i = 0; i <= QModbusTcpClient::GatewayTargetFailedToRespond; i++)
+    {
+        exceptionCounters[i] = 0;
+    }
+}
+
+void QModbusCompactFleet::setExceptionBackoff(int initialDelayMs, int maxDelayMs)
+{
+    exceptionBackoffInitialDelay = qMax(0, initialDelayMs);
+    exceptionBackoffMaxDelay = qMax(exceptionBackoffInitialDelay, maxDelayMs);
+}
+
+bool QModbusCompactFleet::isHoldingSends(int device)
+{
+    Device * d = getDevice(device);
+    if(d == nullptr || d->state != Connected || !(d->flags & TimerArmed))
+    {
+        return false;
+    }
+
+    if((qint32)(d->timerDue - getTime()) > 0)
+    {
+        return true;
+    }
+
+    d->flags &= ~TimerArmed;
+    return false;
+}
+
+bool QModbusCompactFleet::connectDevice(int device)
+{
+    Device * d = getDevice(device);
+    if(d == nullptr || d->state != Disconnected)
+    {
+        return false;
+    }
+
+    d->flags &= ~(UserDisconnected | TimerArmed);
+    d->backoffStep = 0;
+    return startConnectAttempt(device);
+}
+
+bool QModbusCompactFleet::startConnectAttempt(int device)
+{
+    Device * d = &devices[device];
+
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0)
+    {
+        qDebug() << "QModbusCompactFleet::connectDevice - Unable to create socket :" << strerror(errno);
+        scheduleReconnect(device);
+        return false;
+    }
+
+    int one = 1;
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(d->port);
+    address.sin_addr.s_addr = htonl(d->ipv4Address);
+
+    d->socket = fd;
+    if(::connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0)
+    {
+        d->state = Connected;
+        d->backoffStep = 0;
+        emit onDeviceConnected(device);
+    }
+    else if(errno == EINPROGRESS)
+    {
+        d->state = Connecting;
+        watchSocket(device, QSocketNotifier::Write);
+
+        if(autoReconnect && connectTimeout > 0)
+        {
+            d = &devices[device];
+            d->timerDue = getTime() + connectTimeout;
+            d->flags |= TimerArmed;
+            scheduleDeviceTimer(d->timerDue);
+        }
+    }
+    else
+    {
+        ::close(fd);
+        d->socket = -1;
+        scheduleReconnect(device);
+        return false;
+    }
+
+    return true;
+}
+
+void QModbusCompactFleet::onConnectFailed(int device)
+{
+    unwatchSocket(device);
+
+    Device * d = &devices[device];
+    ::close(d->socket);
+    d->socket = -1;
+    d->state = Disconnected;
+    d->flags &= ~TimerArmed;
+
+    scheduleReconnect(device);
+    emit onDeviceDisconnected(device);
+}
+
+void QModbusCompactFleet::disconnectDevice(int device)
+{
+    Device * d = getDevice(device);
+    if(d == nullptr)
+    {
+        return;
+    }
+
+    d->flags |= UserDisconnected;
+    d->flags &= ~TimerArmed;
+
+    if(d->state != Disconnected)
+    {
+        closeDevice(device);
+    }
+}
+
+void QModbusCompactFleet::closeDevice(int device)
+{
+    unwatchSocket(device);
+
+    Device * d = &devices[device];
+    releaseBuffer(d);
+    ::close(d->socket);
+    d->socket = -1;
+    d->state = Disconnected;
+    d->flags &= ~TimerArmed;
+    d->backoffStep = 0;
+
+    PendingSlot aborted[COMPACT_MAX_INFLIGHT];
+    memcpy(aborted, d->pending, sizeof(aborted));
+    memset(d->pending, 0, sizeof(d->pending));
+
+    scheduleReconnect(device);
+
+    for(int i = 0; i < COMPACT_MAX_INFLIGHT; i++)
+    {
+        if(aborted[i].functionCode != 0)
+        {
+            emit onRequestAborted(device, aborted[i].transactionId, aborted[i].functionCode, aborted[i].address);
+        }
+    }
+
+    emit onDeviceDisconnected(device);
+}
+
+void QModbusCompactFleet::scheduleReconnect(int device)
+{
+    Device * d = &devices[device];
+    if(!autoReconnect || (d->flags & (UserDisconnected | TimerArmed)))
+    {
+        return;
+    }
+
+    int delay = QModbusTcpClient::getReconnectDelay(reconnectInitialDelay, reconnectMaxDelay, d->backoffStep);
+    if(d->backoffStep < 0xFF)
+    {
+        d->backoffStep++;
+    }
+
+    d->timerDue = getTime() + delay;
+    d->flags |= TimerArmed;
+    scheduleDeviceTimer(d->timerDue);
+}
+
+void QModbusCompactFleet::scheduleDeviceTimer(quint32 due)
+{
+    // A single timer for the whole fleet, only moved when a device is due earlier :
+    if(!deviceTimer.isActive() || (qint32)(due - deviceTimerDue) < 0)
+    {
+        deviceTimerDue = due;
+        deviceTimer.start(qMax<qint32>(0, (qint32)(due - getTime())));
+    }
+}
+
+void QModbusCompactFleet::onDeviceTimeout()
+{
+    quint32 now = getTime();
+
+    for(int i = 0; i < devices.size(); i++)
+    {
+        Device * d = &devices[i];
+        if(d->state == Connected)
+        {
+            abortExpiredRequests(i, now);
+            continue;
+        }
+
+        if(!(d->flags & TimerArmed))
+        {
+            continue;
+        }
+
+        if((qint32)(d->timerDue - now) > 0)
+        {
+            scheduleDeviceTimer(d->timerDue);
+        }
+        else if(d->state == Disconnected)
+        {
+            d->flags &= ~TimerArmed;
+            startConnectAttempt(i);
+        }
+        else
+        {
+            qDebug() << "QModbusCompactFleet::onDeviceTimeout - Connection attempt timed out.";
+            onConnectFailed(i);
+        }
+    }
+}
+
+void QModbusCompactFleet::abortExpiredRequests(int device, quint32 now)
+{
+    Device * d = &devices[device];
+    PendingSlot expired[COMPACT_MAX_INFLIGHT];
+    int nbExpired = 0;
+
+    for(int i = 0; i < COMPACT_MAX_INFLIGHT; i++)
+    {
+        if(d->pending[i].functionCode == 0 || responseTimeout <= 0)
+        {
+            continue;
+        }
+
+        if((qint32)(d->pending[i].responseDue - now) <= 0)
+        {
+            // A device or gateway silently dropping requests would otherwise keep its slots forever :
+            expired[nbExpired++] = d->pending[i];
+            d->pending[i].functionCode = 0;
+        }
+        else
+        {
+            scheduleDeviceTimer(d->pending[i].responseDue);
+        }
+    }
+
+    if(nbExpired == 0)
+    {
+        return;
+    }
+
+    if(!hasPendingRequests(d) && d->buffer == nullptr)
+    {
+        unwatchSocket(device);
+    }
+
+    for(int i = 0; i < nbExpired; i++)
+    {
+        emit onRequestAborted(device, expired[i].transactionId, expired[i].functionCode, expired[i].address);
+    }
+}
+
+void QModbusCompactFleet::onIdleCheckTimeout()
+{
+    // Idle connections own no notifier, a close or reset by the device is only seen here :
+    QVector<struct pollfd> fds;
+    QVector<int> fdDevices;
+    for(int i = 0; i < devices.size(); i++)
+    {
+        if(devices[i].state == Connected && devices[i].notifier == nullptr)
+        {
+            struct pollfd fd;
+            fd.fd = devices[i].socket;
+            fd.events = POLLIN;
+            fd.revents = 0;
+            fds.push_back(fd);
+            fdDevices.push_back(i);
+        }
+    }
+
+    if(fds.isEmpty() || ::poll(fds.data(), fds.size(), 0) <= 0)
+    {
+        return;
+    }
+
+    for(int i = 0; i < fds.size(); i++)
+    {
+        int device = fdDevices[i];
+        Device * d = &devices[device];
+        if(fds[i].revents == 0 || d->state != Connected || d->socket != fds[i].fd)
+        {
+            continue;
+        }
+
+        char byte;
+        ssize_t nbRead = ::recv(d->socket, &byte, 1, MSG_PEEK);
+        if(nbRead > 0)
+        {
+            // Data nobody waits for, read and dropped by the usual path :
+            watchSocket(device, QSocketNotifier::Read);
+        }
+        else if(nbRead == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            closeDevice(device);
+        }
+    }
+}
+
+void QModbusCompactFleet::onExceptionReceived(int device, quint8 exceptionCode)
+{
+    QModbusTcpClient::ExceptionCode code = QModbusTcpClient::toExceptionCode(exceptionCode);
+    exceptionCounters[code]++;
+
+    if(QModbusTcpClient::isSendHoldException(code))
+    {
+        Device * d = &devices[device];
+        int delay = QModbusTcpClient::getExceptionHoldDelay(exceptionBackoffInitialDelay, exceptionBackoffMaxDelay, d->backoffStep);
+
+        if(d->backoffStep < 0xFF)
+        {
+            d->backoffStep++;
+        }
+
+        if(delay > 0)
+        {
+            d->timerDue = getTime() + delay;
+            d->flags |= TimerArmed;
+            emit onSendHold(device, delay);
+        }
+    }
+}
+
+bool QModbusCompactFleet::hasPendingRequests(Device * device)
+{
+    for(int i = 0; i < COMPACT_MAX_INFLIGHT; i++)
+    {
+        if(device->pending[i].functionCode != 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void QModbusCompactFleet::watchSocket(int device, QSocketNotifier::Type type)
+{
+    Device * d = &devices[device];
+    if(d->notifier != nullptr)
+    {
+        if(d->notifier->type() == type)
+        {
+            return;
+        }
+        unwatchSocket(device);
+    }
+
+    d->notifier = new QSocketNotifier(d->socket, type, this);
+    QObject::connect(d->notifier, SIGNAL(activated(int)), this, SLOT(onSocketActivated(int)));
+    activeSockets[d->socket] = device;
+}
+
+void QModbusCompactFleet::unwatchSocket(int device)
+{
+    Device * d = &devices[device];
+    if(d->notifier == nullptr)
+    {
+        return;
+    }
+
+    // May be called from the notifier's own signal :
+    d->notifier->setEnabled(false);
+    d->notifier->deleteLater();
+    d->notifier = nullptr;
+    activeSockets.remove(d->socket);
+}
+
+void QModbusCompactFleet::borrowBuffer(Device * device)
+{
+    if(device->buffer != nullptr)
+    {
+        return;
+    }
+
+    if(bufferPool.isEmpty())
+    {
+        device->buffer = new char[COMPACT_BUFFER_SIZE];
+    }
+    else
+    {
+        device->buffer = bufferPool.takeLast();
+    }
+    device->bufferFill = 0;
+    borrowedBufferCount++;
+}
+
+void QModbusCompactFleet::releaseBuffer(Device * device)
+{
+    if(device->buffer == nullptr)
+    {
+        return;
+    }
+
+    bufferPool.push_back(device->buffer);
+    device->buffer = nullptr;
+    device->bufferFill = 0;
+    borrowedBufferCount--;
+}
+
+int QModbusCompactFleet::findFreeSlot(Device * device)
+{
+    for(int i = 0; i < COMPACT_MAX_INFLIGHT; i++)
+    {
+        if(device->pending[i].functionCode == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+QModbusCompactFleet::Device * QModbusCompactFleet::getReadyDevice(int device)
+{
+    Device * d = getDevice(device);
+    if(d == nullptr || d->state != Connected || isHoldingSends(device) || findFreeSlot(d) < 0)
+    {
+        return nullptr;
+    }
+    return d;
+}
+
+bool QModbusCompactFleet::sendRequest(int device, const char * trame, int length, quint8 functionCode, quint16 address, quint16 value)
+{
+    Device * d = &devices[device];
+    int slot = findFreeSlot(d);
+    d->transactionId++;
+
+    if(::send(d->socket, trame, length, MSG_NOSIGNAL) != (ssize_t)length)
+    {
+        closeDevice(device);
+        return false;
+    }
+
+    d->pending[slot].transactionId = ModbusFrame::getTransactionId((const unsigned char *)trame);
+    d->pending[slot].address = address;
+    d->pending[slot].value = value;
+    d->pending[slot].functionCode = functionCode;
+
+    if(responseTimeout > 0)
+    {
+        // Deadlines are rounded up to 128 ms so the fleet timer doesn't fire (and scan every device) per request :
+        d->pending[slot].responseDue = (getTime() + responseTimeout + 127) & ~127u;
+        scheduleDeviceTimer(d->pending[slot].responseDue);
+    }
+
+    watchSocket(device, QSocketNotifier::Read);
+    return true;
+}
+
+bool QModbusCompactFleet::writeSingleWordFC6(int device, quint16 wordAddress, quint16 wordValue)
+{
+    Device * d = getReadyDevice(device);
+    if(d == nullptr)
+    {
+        return false;
+    }
+
+    char trame[SINGLE_REQUEST_SIZE];
+    int length = ModbusFrame::encodeRequest(trame, d->transactionId, d->unitId, 0x06, wordAddress, wordValue);
+    return sendRequest(device, trame, length, 0x06, wordAddress, wordValue);
+}
+
+bool QModbusCompactFleet::readMultipleHoldingRegistersFC3(int device, quint16 startAddress, quint16 nbWord)
+{
+    Device * d = getReadyDevice(device);
+    if(d == nullptr)
+    {
+        return false;
+    }
+
+    char trame[SINGLE_REQUEST_SIZE];
+    int length = ModbusFrame::encodeRequest(trame, d->transactionId, d->unitId, 0x03, startAddress, nbWord);
+    return sendRequest(device, trame, length, 0x03, startAddress, nbWord);
+}
+
+bool QModbusCompactFleet::readMultipleInputRegistersFC4(int device, quint16 startAddress, quint16 nbWord)
+{
+    Device * d = getReadyDevice(device);
+    if(d == nullptr)
+    {
+        return false;
+    }
+
+    char trame[SINGLE_REQUEST_SIZE];
+    int length = ModbusFrame::encodeRequest(trame, d->transactionId, d->unitId, 0x04, startAddress, nbWord);
+    return sendRequest(device, trame, length, 0x04, startAddress, nbWord);
+}
+
+bool QModbusCompactFleet::forceSingleCoilFC5(int device, quint16 coilAddress, bool value)
+{
+    Device * d = getReadyDevice(device);
+    if(d == nullptr)
+    {
+        return false;
+    }
+
+    quint16 coilValue = value ? 0xFF00 : 0x0000;
+    char trame[SINGLE_REQUEST_SIZE];
+    int length = ModbusFrame::encodeRequest(trame, d->transactionId, d->unitId, 0x05, coilAddress, coilValue);
+    return sendRequest(device, trame, length, 0x05, coilAddress, coilValue);
+}
+
+bool QModbusCompactFleet::forceMultipleCoilsFC15(int device, quint16 startAddress, QVector<bool> values)
+{
+    if(values.isEmpty() || values.size() > 1968)
+    {
+        qDebug() << "QModbusCompactFleet::forceMultipleCoilsFC15 - A request writes 1 to 1968 coils ... Operation aborted.";
+        return false;
+    }
+
+    Device * d = getReadyDevice(device);
+    if(d == nullptr)
+    {
+        return false;
+    }
+
+    char trame[COMPACT_BUFFER_SIZE];
+    int length = ModbusFrame::encodeForceMultipleCoils(trame, d->transactionId, d->unitId, startAddress, values.constData(), values.size());
+    return sendRequest(device, trame, length, 0x0F, startAddress, values.size());
+}
+
+bool QModbusCompactFleet::readMultipleInputsStatusFC2(int device, quint16 startAddress, quint16 nbInput)
+{
+    Device * d = getReadyDevice(device);
+    if(d == nullptr)
+    {
+        return false;
+    }
+
+    char trame[SINGLE_REQUEST_SIZE];
+    int length = ModbusFrame::encodeRequest(trame, d->transactionId, d->unitId, 0x02, startAddress, nbInput);
+    return sendRequest(device, trame, length, 0x02, startAddress, nbInput);
+}
+
+bool QModbusCompactFleet::presetMultipleRegistersFC16(int device, quint16 startAddress, QVector<quint16> values)
+{
+    if(values.isEmpty() || values.size() > 123)
+    {
+        qDebug() << "QModbusCompactFleet::presetMultipleRegistersFC16 - A request writes 1 to 123 registers ... Operation aborted.";
+        return false;
+    }
+
+    Device * d = getReadyDevice(device);
+    if(d == nullptr)
+    {
+        return false;
+    }
+
+    char trame[COMPACT_BUFFER_SIZE];
+    int length = ModbusFrame::encodePresetMultipleRegisters(trame, d->transactionId, d->unitId, startAddress, values.constData(), values.size());
+    return sendRequest(device, trame, length, 0x10, startAddress, values.size());
+}
+
+void QModbusCompactFleet::onSocketActivated(int socket)
+{
+    int device = activeSockets.value(socket, -1);
+    if(device < 0)
+    {
+        return;
+    }
+
+    Device * d = &devices[device];
+
+    if(d->state == Connecting)
+    {
+        int error = 0;
+        socklen_t errorLength = sizeof(error);
+        ::getsockopt(d->socket, SOL_SOCKET, SO_ERROR, &error, &errorLength);
+        unwatchSocket(device);
+
+        if(error != 0)
+        {
+            onConnectFailed(device);
+        }
+        else
+        {
+            d = &devices[device];
+            d->state = Connected;
+            d->flags &= ~TimerArmed;
+            d->backoffStep = 0;
+            emit onDeviceConnected(device);
+        }
+        return;
+    }
+
+    borrowBuffer(d);
+    ssize_t nbRead = ::recv(d->socket, d->buffer + d->bufferFill, COMPACT_BUFFER_SIZE - d->bufferFill, 0);
+
+    if(nbRead == 0 || (nbRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+        closeDevice(device);
+        return;
+    }
+
+    if(nbRead > 0)
+    {
+        d->bufferFill += nbRead;
+        processSentences(device);
+    }
+
+    // Signals emitted while processing may have changed the fleet :
+    d = &devices[device];
+    if(d->state == Connected)
+    {
+        if(d->bufferFill == 0)
+        {
+            releaseBuffer(d);
+        }
+
+        if(!hasPendingRequests(d) && d->buffer == nullptr)
+        {
+            unwatchSocket(device);
+        }
+    }
+}
+
+void QModbusCompactFleet::processSentences(int device)
+{
+    unsigned char sentence[COMPACT_BUFFER_SIZE];
+
+    while(true)
+    {
+        Device * d = &devices[device];
+        if(d->state != Connected || d->buffer == nullptr || d->bufferFill < 6)
+        {
+            return;
+        }
+
+        int totalLength = ModbusFrame::getSentenceLength(d->buffer, d->bufferFill);
+        if(totalLength > COMPACT_BUFFER_SIZE || totalLength < 9)
+        {
+            qDebug() << "QModbusCompactFleet::processSentences - Received an invalid sentence length, closing the connection.";
+            closeDevice(device);
+            return;
+        }
+
+        if(d->bufferFill < totalLength)
+        {
+            return;
+        }
+
+        memcpy(sentence, d->buffer, totalLength);
+        d->bufferFill -= totalLength;
+        memmove(d->buffer, d->buffer + totalLength, d->bufferFill);
+
+        processSentence(device, sentence, totalLength);
+    }
+}
+
+void QModbusCompactFleet::processSentence(int device, const unsigned char * sentence, int length)
+{
+    Device * d = &devices[device];
+    quint16 transactionId = ModbusFrame::getTransactionId(sentence);
+
+    int slot = -1;
+    for(int i = 0; i < COMPACT_MAX_INFLIGHT && slot < 0; i++)
+    {
+        if(d->pending[i].functionCode != 0 && d->pending[i].transactionId == transactionId)
+        {
+            slot = i;
+        }
+    }
+
+    if(slot < 0)
+    {
+        qDebug() << "Received sentence to unknown request ...";
+        return;
+    }
+
+    PendingSlot request = d->pending[slot];
+    d->pending[slot].functionCode = 0;
+
+    if(ModbusFrame::isException(sentence, length, request.functionCode))
+    {
+        quint8 exceptionCode = ModbusFrame::getExceptionCode(sentence);
+        onExceptionReceived(device, exceptionCode);
+        emit onModbusException(device, transactionId, request.functionCode, request.address, QModbusTcpClient::toExceptionCode(exceptionCode));
+        return;
+    }
+
+    // Write responses echo the address and the value or quantity written :
+    quint8 functionCode = ModbusFrame::getFunctionCode(sentence);
+    bool isWrite = (functionCode == 0x05 || functionCode == 0x06 || functionCode == 0x0F || functionCode == 0x10);
+    if(functionCode != request.functionCode || (isWrite && length < SINGLE_REQUEST_SIZE))
+    {
+        qDebug() << "QModbusCompactFleet::processSentence - Received an incoherent sentence to request.";
+        emit onRequestAborted(device, transactionId, request.functionCode, request.address);
+        return;
+    }
+
+    d->backoffStep = 0;
+
+    if(functionCode == 0x03 || functionCode == 0x04)
+    {
+        QVector<quint16> values(length / 2);
+        values.resize(ModbusFrame::decodeRegisters(sentence, length, values.data(), values.size()));
+
+        if(functionCode == 0x03)
+        {
+            emit onReadMultipleHoldingRegistersSentence(device, request.address, values);
+        }
+        else
+        {
+            emit onReadMultipleInputRegistersSentence(device, request.address, values);
+        }
+    }
+    else if(functionCode == 0x02)
+    {
+        QVector<bool> values(request.value);
+        values.resize(ModbusFrame::decodeBits(sentence, length, values.data(), values.size()));
+        emit onReadMultipleInputsStatusSentence(device, request.address, values);
+    }
+    else if(isWrite)
+    {
+        quint16 address = ModbusFrame::getWord(&sentence[8]);
+        quint16 value = ModbusFrame::getWord(&sentence[10]);
+        bool success = (request.address == address && request.value == value);
+
+        switch(functionCode)
+        {
+        case 0x05:
+            emit onForceSingleCoilSentence(device, success, address, value == 0xFF00);
+            break;
+        case 0x06:
+            emit onWriteSingleWordSentence(device, success, address, value);
+            break;
+        case 0x0F:
+            emit onForceMultipleCoilsSentence(device, success, address, value);
+            break;
+        case 0x10:
+            emit onPresetMultipleRegistersSentence(device, success, address, value);
+            break;
+        }
+    }
+}
@@ -0,0 +1,189 @@
+#ifndef QModbusCompactFleet_H
+#define QModbusCompactFleet_H
+
+#include <QObject>
+#include <QVector>
+#include <QHash>
+#include <QHostAddress>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "qmodbustcpclient.h"
+
+#define COMPACT_MAX_INFLIGHT 4
+#define COMPACT_BUFFER_SIZE 260 // Largest Modbus TCP ADU
+
+// Low-memory mode for very large fleets : a single QObject drives every device, which are
+// addressed by the index returned by addDevice(). An idle device only keeps its socket
+// descriptor and a few bytes of state. A socket notifier exists only while connecting or
+// waiting for a response, and a receive buffer is borrowed from a shared pool only while
+// a response is arriving. Frames are encoded and decoded by ModbusFrame, as in QModbusTcpClient.
+// Uses POSIX sockets (Unix only) and IPv4 addresses. Request values aren't kept, so pending
+// requests are aborted on a connection loss instead of being replayed after the reconnect.
+// Idle connections are checked for a close or reset by a periodic poll of their sockets.
+class QModbusCompactFleet : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum DeviceState {
+        Disconnected,
+        Connecting,
+        Connected
+    };
+    Q_ENUM(DeviceState)
+
+private:
+    enum DeviceFlag {
+        UserDisconnected = 0x01,
+        TimerArmed = 0x02 // timerDue is the reconnect time, the connect deadline or the end of the send hold, by state
+    };
+
+    struct PendingSlot
+    {
+        quint16 transactionId;
+        quint16 address;
+        quint16 value;       // Quantity read or written, value written by FC5 / FC6
+        quint8 functionCode; // 0 when the slot is free
+        quint8 reserved;
+        quint32 responseDue;
+    };
+
+    struct Device
+    {
+        quint32 ipv4Address;
+        quint32 timerDue;
+        quint16 port;
+        quint8 unitId;
+        quint8 state;
+        quint16 transactionId;
+        quint16 bufferFill;
+        int socket;
+        quint8 backoffStep; // Reconnect attempt while disconnected, exception backoff step while connected
+        quint8 flags;
+        char * buffer;
+        QSocketNotifier * notifier;
+        PendingSlot pending[COMPACT_MAX_INFLIGHT];
+    };
+
+    QVector<Device> devices;
+    QHash<int, int> activeSockets; // Socket descriptor -> device, for devices owning a notifier
+    QVector<char*> bufferPool;
+    int borrowedBufferCount;
+
+    // Reconnect supervisor :
+    bool autoReconnect;
+    int reconnectInitialDelay;
+    int reconnectMaxDelay;
+    int connectTimeout;
+    int responseTimeout;
+    QElapsedTimer clock;
+    QTimer deviceTimer; // Armed for the earliest reconnect, connect or response deadline of the fleet
+    quint32 deviceTimerDue;
+    QTimer idleCheckTimer;
+
+    // Exceptions :
+    quint32 exceptionCounters[QModbusTcpClient::GatewayTargetFailedToRespond + 1];
+    int exceptionBackoffInitialDelay;
+    int exceptionBackoffMaxDelay;
+
+    Device * getDevice(int device);
+    quint32 getTime();
+    int findFreeSlot(Device * device);
+    Device * getReadyDevice(int device);
+    bool sendRequest(int device, const char * trame, int length, quint8 functionCode, quint16 address, quint16 value);
+    void processSentences(int device);
+    void processSentence(int device, const unsigned char * sentence, int length);
+    void watchSocket(int device, QSocketNotifier::Type type);
+    void unwatchSocket(int device);
+    void borrowBuffer(Device * device);
+    void releaseBuffer(Device * device);
+    bool startConnectAttempt(int device);
+    void onConnectFailed(int device);
+    void closeDevice(int device);
+    void scheduleReconnect(int device);
+    void scheduleDeviceTimer(quint32 due);
+    void abortExpiredRequests(int device, quint32 now);
+    void onExceptionReceived(int device, quint8 exceptionCode);
+    bool hasPendingRequests(Device * device);
+
+public:
+    explicit QModbusCompactFleet(QObject *parent = nullptr);
+    virtual ~QModbusCompactFleet();
+
+    // Return the device index, -1 if the address isn't IPv4 :
+    int addDevice(QHostAddress address, quint16 port = 502, quint8 unitId = 0);
+    int getDeviceCount();
+    DeviceState getDeviceState(int device);
+
+    // Return false if the connection couldn't be started, it is retried later when auto reconnect is enabled :
+    bool connectDevice(int device);
+    void disconnectDevice(int device);
+
+    // Same backoff as QModbusTcpClient : the first retry is immediate, then each delay
+    // is drawn in [ceiling / 2, ceiling] with ceiling doubling up to maxDelayMs.
+    void setAutoReconnect(bool enabled);
+    void setReconnectBackoff(int initialDelayMs, int maxDelayMs);
+    // Timeout of a single connection attempt when auto reconnect is enabled, 0 disables it.
+    void setConnectTimeout(int timeoutMs);
+    // Time allowed for a response, past it the request is aborted and its slot freed, 0 disables it.
+    void setResponseTimeout(int timeoutMs);
+    // Period of the check for idle connections closed by the device, 0 disables it.
+    void setIdleCheckInterval(int intervalMs);
+
+    quint32 getExceptionCount(QModbusTcpClient::ExceptionCode exceptionCode);
+    void resetExceptionCounters();
+    // Requests to a device are rejected for a growing delay after a busy or gateway exception, reset on the next normal response :
+    void setExceptionBackoff(int initialDelayMs, int maxDelayMs);
+    bool isHoldingSends(int device);
+
+    // Return false if the device isn't connected, holds its sends or already has COMPACT_MAX_INFLIGHT requests in flight :
+    bool writeSingleWordFC6(int device, quint16 wordAddress, quint16 wordValue);
+    bool readMultipleHoldingRegistersFC3(int device, quint16 startAddress, quint16 nbWord);
+    bool readMultipleInputRegistersFC4(int device, quint16 startAddress, quint16 nbWord);
+    bool forceSingleCoilFC5(int device, quint16 coilAddress, bool value);
+    bool forceMultipleCoilsFC15(int device, quint16 startAddress, QVector<bool> values);
+    bool readMultipleInputsStatusFC2(int device, quint16 startAddress, quint16 nbInput);
+    bool presetMultipleRegistersFC16(int device, quint16 startAddress, QVector<quint16> values);
+
+    static int getDeviceStateSize();
+    int getBorrowedBufferCount();
+    int getPooledBufferCount();
+
+signals:
+    void onDeviceConnected(int device);
+    void onDeviceDisconnected(int device);
+
+    // FC 06 (0x06)
+    void onWriteSingleWordSentence(int device, bool writeSuccess, quint16 wordAddress, quint16 wordValue);
+
+    // FC 03 (0x03)
+    void onReadMultipleHoldingRegistersSentence(int device, quint16 startAddress, QVector<quint16> values);
+
+    // FC 04 (0x04)
+    void onReadMultipleInputRegistersSentence(int device, quint16 startAddress, QVector<quint16> values);
+
+    // FC 05 (0x05)
+    void onForceSingleCoilSentence(int device, bool writeSuccess, quint16 coilAddress, bool value);
+
+    // FC 15 (0x0F)
+    void onForceMultipleCoilsSentence(int device, bool writeSuccess, quint16 startAddress, quint16 numberOfCoilsWritten);
+
+    // FC 02 (0x02)
+    void onReadMultipleInputsStatusSentence(int device, quint16 startAddress, QVector<bool> values);
+
+    // FC 16 (0x10)
+    void onPresetMultipleRegistersSentence(int device, bool writeSuccess, quint16 startAddress, quint16 nbValueWritten);
+
+    void onRequestAborted(int device, quint16 transactionId, quint8 functionCode, quint16 address);
+    void onModbusException(int device, quint16 transactionId, quint8 functionCode, quint16 address, QModbusTcpClient::ExceptionCode exceptionCode);
+    // Requests to the device are rejected for delayMs after a busy or gateway exception :
+    void onSendHold(int device, int delayMs);
+
+private slots:
+    void onSocketActivated(int socket);
+    void onDeviceTimeout();
+    void onIdleCheckTimeout();
+};
+
+#endif // QModbusCompactFleet_H
@@ -0,0 +1,163 @@
+#include "qmodbusframe.h"
+#include <string.h>
+
+bool ModbusFrame::getBit(char byte, int bitNumber)
+{
+    quint8 value = (byte >> bitNumber) & 0x01;
+    return value != 0;
+}
+
+void ModbusFrame::setBit(char * byte, int bitNumber, bool value)
+{
+    quint8 mask = (1 << bitNumber);
+    quint8 orValue = 0 + (value ? mask : 0);
+    *byte |= orValue;
+}
+
+char ModbusFrame::getMSB(quint16 value)
+{
+    return (value & 0xFF00) >> 8;
+}
+
+char ModbusFrame::getLSB(quint16 value)
+{
+    return (value & 0x00FF);
+}
+
+quint16 ModbusFrame::getWord(const unsigned char * ptr)
+{
+    return (ptr[0] << 8) | ptr[1];
+}
+
+void ModbusFrame::setHeader(char * ptr, quint16 transactionId, quint16 length, quint8 unitId, quint8 functionCode)
+{
+    ptr[0] = getMSB(transactionId);
+    ptr[1] = getLSB(transactionId);
+    ptr[2] = 0x00;
+    ptr[3] = 0x00;
+    ptr[LENGTH_IDX] = getMSB(length);
+    ptr[LENGTH_IDX + 1] = getLSB(length);
+    ptr[UNIT_IDENTIFIER_IDX] = unitId;
+    ptr[FUNCTION_IDX] = functionCode;
+}
+
+int ModbusFrame::encodeRequest(char * ptr, quint16 transactionId, quint8 unitId, quint8 functionCode, quint16 address, quint16 value)
+{
+    setHeader(ptr, transactionId, SINGLE_REQUEST_SIZE - MBAP_HEADER_SIZE, unitId, functionCode);
+    ptr[8] = getMSB(address);
+    ptr[9] = getLSB(address);
+    ptr[10] = getMSB(value);
+    ptr[11] = getLSB(value);
+    return SINGLE_REQUEST_SIZE;
+}
+
+int ModbusFrame::getForceMultipleCoilsSize(quint16 count)
+{
+    return 13 + (count + 7) / 8;
+}
+
+int ModbusFrame::encodeForceMultipleCoils(char * ptr, quint16 transactionId, quint8 unitId, quint16 startAddress, const bool * values, quint16 count)
+{
+    int length = getForceMultipleCoilsSize(count);
+    setHeader(ptr, transactionId, length - MBAP_HEADER_SIZE, unitId, 0x0F);
+    ptr[8] = getMSB(startAddress);
+    ptr[9] = getLSB(startAddress);
+    ptr[10] = getMSB(count);
+    ptr[11] = getLSB(count);
+    ptr[12] = length - 13;
+
+    memset(&ptr[13], 0, length - 13);
+    for(int i = 0; i < count; i++)
+    {
+        setBit(&ptr[13 + (i / 8)], i % 8, values[i]);
+    }
+    return length;
+}
+
+int ModbusFrame::getPresetMultipleRegistersSize(quint16 count)
+{
+    return 13 + 2 * count;
+}
+
+int ModbusFrame::encodePresetMultipleRegisters(char * ptr, quint16 transactionId, quint8 unitId, quint16 startAddress, const quint16 * values, quint16 count)
+{
+    int length = getPresetMultipleRegistersSize(count);
+    setHeader(ptr, transactionId, length - MBAP_HEADER_SIZE, unitId, 0x10);
+    ptr[8] = getMSB(startAddress);
+    ptr[9] = getLSB(startAddress);
+    ptr[10] = getMSB(count);
+    ptr[11] = getLSB(count);
+    ptr[12] = 2 * count;
+
+    for(int i = 0; i < count; i++)
+    {
+        int currentIdx = 13 + (2 * i);
+        ptr[currentIdx] = getMSB(values[i]);
+        ptr[currentIdx + 1] = getLSB(values[i]);
+    }
+    return length;
+}
+
+int ModbusFrame::getSentenceLength(const char * buffer, int size)
+{
+    if(size < MBAP_HEADER_SIZE)
+    {
+        return 0;
+    }
+
+    return MBAP_HEADER_SIZE + (((quint8)buffer[LENGTH_IDX] << 8) | (quint8)buffer[LENGTH_IDX + 1]);
+}
+
+quint16 ModbusFrame::getTransactionId(const unsigned char * sentence)
+{
+    return getWord(sentence);
+}
+
+quint8 ModbusFrame::getFunctionCode(const unsigned char * sentence)
+{
+    return sentence[FUNCTION_IDX];
+}
+
+bool ModbusFrame::isException(const unsigned char * sentence, int length, quint8 requestFunctionCode)
+{
+    return length > 8 && sentence[FUNCTION_IDX] == (requestFunctionCode | 0x80);
+}
+
+quint8 ModbusFrame::getExceptionCode(const unsigned char * sentence)
+{
+    return sentence[8];
+}
+
+int ModbusFrame::decodeRegisters(const unsigned char * sentence, int length, quint16 * values, int maxCount)
+{
+    if(length < 9)
+    {
+        return 0;
+    }
+
+    int numberOfWord = qMin<int>(sentence[8], length - 9) / 2;
+    numberOfWord = qMin(numberOfWord, maxCount);
+
+    for(int i = 0; i < numberOfWord; i++)
+    {
+        values[i] = getWord(&sentence[9 + (i * 2)]);
+    }
+    return numberOfWord;
+}
+
+int ModbusFrame::decodeBits(const unsigned char * sentence, int length, bool * values, int maxCount)
+{
+    if(length < 9)
+    {
+        return 0;
+    }
+
+    int nbByteToRead = qMin<int>(sentence[8], length - 9);
+    int nbBitRead = qMin(nbByteToRead * 8, maxCount);
+
+    for(int i = 0; i < nbBitRead; i++)
+    {
+        values[i] = getBit(sentence[9 + (i / 8)], i % 8);
+    }
+    return nbBitRead;
+}
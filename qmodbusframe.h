@@ -0,0 +1,52 @@
+#ifndef ModbusFrame_H
+#define ModbusFrame_H
+
+#include <QtGlobal>
+
+#define LENGTH_IDX 4
+#define UNIT_IDENTIFIER_IDX 6
+#define FUNCTION_IDX 7
+
+#define MBAP_HEADER_SIZE 6
+#define SINGLE_REQUEST_SIZE 12 // FC2, FC3, FC4, FC5 and FC6 requests, FC5, FC6, FC15 and FC16 responses
+
+// Modbus TCP frame encoding and decoding, shared by QModbusTcpClient and QModbusCompactFleet.
+// Encoders write into a caller buffer large enough for the frame and return its size.
+// Decoders take a complete sentence (MBAP header included) and never read past its length.
+class ModbusFrame
+{
+public:
+    static bool getBit(char byte, int bitNumber);
+    static void setBit(char * byte, int bitNumber, bool value);
+    static char getMSB(quint16 value);
+    static char getLSB(quint16 value);
+    static quint16 getWord(const unsigned char * ptr);
+
+    // MBAP header and function code, length counts the bytes following the length field :
+    static void setHeader(char * ptr, quint16 transactionId, quint16 length, quint8 unitId, quint8 functionCode);
+
+    // Address followed by a quantity or a value, i.e. FC2, FC3, FC4, FC5 (value 0xFF00 or 0x0000) and FC6 :
+    static int encodeRequest(char * ptr, quint16 transactionId, quint8 unitId, quint8 functionCode, quint16 address, quint16 value);
+
+    static int getForceMultipleCoilsSize(quint16 count);
+    static int encodeForceMultipleCoils(char * ptr, quint16 transactionId, quint8 unitId, quint16 startAddress, const bool * values, quint16 count);
+
+    static int getPresetMultipleRegistersSize(quint16 count);
+    static int encodePresetMultipleRegisters(char * ptr, quint16 transactionId, quint8 unitId, quint16 startAddress, const quint16 * values, quint16 count);
+
+    // Length of the sentence starting the buffer, 0 while its header isn't complete :
+    static int getSentenceLength(const char * buffer, int size);
+    static quint16 getTransactionId(const unsigned char * sentence);
+    static quint8 getFunctionCode(const unsigned char * sentence);
+
+    // True if the sentence is the exception response to a request of this function code :
+    static bool isException(const unsigned char * sentence, int length, quint8 requestFunctionCode);
+    static quint8 getExceptionCode(const unsigned char * sentence);
+
+    // FC3 / FC4 responses, return the number of registers decoded (at most maxCount) :
+    static int decodeRegisters(const unsigned char * sentence, int length, quint16 * values, int maxCount);
+    // FC1 / FC2 responses, return the number of bits decoded (at most maxCount) :
+    static int decodeBits(const unsigned char * sentence, int length, bool * values, int maxCount);
+};
+
+#endif // ModbusFrame_H
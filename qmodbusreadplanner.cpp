@@ -0,0 +1,145 @@
+#include "qmodbusreadplanner.h"
+#include <QtMath>
+#include <algorithm>
+
+// Request header (MBAP + FC) + start address + quantity, response header (MBAP + FC) + byte count :
+#define REQUEST_OVERHEAD_BYTES 12
+#define RESPONSE_OVERHEAD_BYTES 9
+
+QModbusTag::QModbusTag()
+{
+    this->address = 0;
+    this->size = 1;
+}
+
+QModbusTag::QModbusTag(quint16 address, quint16 size)
+{
+    this->address = address;
+    this->size = size;
+}
+
+QModbusReadBlock::QModbusReadBlock()
+{
+    this->startAddress = 0;
+    this->count = 0;
+}
+
+QModbusReadBlock::QModbusReadBlock(quint16 startAddress, quint16 count)
+{
+    this->startAddress = startAddress;
+    this->count = count;
+}
+
+QModbusReadPlanner::QModbusReadPlanner(qreal requestCost, qreal byteCost)
+{
+    this->requestCost = requestCost;
+    this->byteCost = byteCost;
+}
+
+void QModbusReadPlanner::setCostModel(qreal requestCost, qreal byteCost)
+{
+    this->requestCost = requestCost;
+    this->byteCost = byteCost;
+}
+
+qreal QModbusReadPlanner::getBlockCost(quint8 functionCode, quint16 count) const
+{
+    int dataBytes = (functionCode == 0x01 || functionCode == 0x02) ? qCeil((qreal)count / (qreal)8.0) : 2 * count;
+    return requestCost + byteCost * (REQUEST_OVERHEAD_BYTES + RESPONSE_OVERHEAD_BYTES + dataBytes);
+}
+
+qreal QModbusReadPlanner::getPlanCost(quint8 functionCode, const QVector<QModbusReadBlock> & plan) const
+{
+    qreal cost = 0;
+    for(int i = 0; i < plan.size(); i++)
+    {
+        cost += getBlockCost(functionCode, plan[i].count);
+    }
+    return cost;
+}
+
+static bool tagLessThan(const QModbusTag & a, const QModbusTag & b)
+{
+    return a.address < b.address;
+}
+
+QVector<QModbusReadBlock> QModbusReadPlanner::plan(const QModbusAddressSpaceMap & map, QVector<QModbusTag> tags, QVector<QModbusTag> * unplannableTags) const
+{
+    quint32 maxBlockSize = map.getMaxBlockSize();
+    if(maxBlockSize == 0)
+    {
+        maxBlockSize = QModbusAddressSpaceMap::getProtocolMaxBlockSize(map.getFunctionCode());
+    }
+
+    // Keep only the tags a single request can read :
+    QVector<QModbusTag> plannableTags;
+    QVector<int> tagRange;
+    for(int i = 0; i < tags.size(); i++)
+    {
+        int range = map.findReadableRange(tags[i].address, tags[i].size);
+        if(tags[i].size == 0 || tags[i].size > maxBlockSize || range < 0)
+        {
+            if(unplannableTags != nullptr)
+            {
+                unplannableTags->push_back(tags[i]);
+            }
+        }
+        else
+        {
+            plannableTags.push_back(tags[i]);
+        }
+    }
+
+    std::sort(plannableTags.begin(), plannableTags.end(), tagLessThan);
+    for(int i = 0; i < plannableTags.size(); i++)
+    {
+        tagRange.push_back(map.findReadableRange(plannableTags[i].address, plannableTags[i].size));
+    }
+
+    // cost[i] : cheapest plan reading the first i tags, firstTag[i] : first tag of the last block of this plan.
+    // A block reads consecutive tags j..i-1, so it is only valid while they fit in one readable range and one request.
+    int nbTags = plannableTags.size();
+    QVector<qreal> cost(nbTags + 1, 0);
+    QVector<int> firstTag(nbTags + 1, 0);
+
+    for(int i = 1; i <= nbTags; i++)
+    {
+        quint32 blockEnd = 0;
+        cost[i] = -1;
+
+        for(int j = i - 1; j >= 0; j--)
+        {
+            blockEnd = qMax<quint32>(blockEnd, (quint32)plannableTags[j].address + plannableTags[j].size);
+            quint32 blockCount = blockEnd - plannableTags[j].address;
+
+            if(blockCount > maxBlockSize || tagRange[j] != tagRange[i - 1])
+            {
+                break;
+            }
+
+            qreal candidate = cost[j] + getBlockCost(map.getFunctionCode(), blockCount);
+            if(cost[i] < 0 || candidate < cost[i])
+            {
+                cost[i] = candidate;
+                firstTag[i] = j;
+            }
+        }
+    }
+
+    QVector<QModbusReadBlock> blocks;
+    int i = nbTags;
+    while(i > 0)
+    {
+        int j = firstTag[i];
+        quint32 blockEnd = 0;
+        for(int k = j; k < i; k++)
+        {
+            blockEnd = qMax<quint32>(blockEnd, (quint32)plannableTags[k].address + plannableTags[k].size);
+        }
+
+        blocks.insert(0, QModbusReadBlock(plannableTags[j].address, blockEnd - plannableTags[j].address));
+        i = j;
+    }
+
+    return blocks;
+}
@@ -0,0 +1,48 @@
+#ifndef QModbusReadPlanner_H
+#define QModbusReadPlanner_H
+
+#include <QVector>
+#include "qmodbusaddressspacediscovery.h"
+
+class QModbusTag
+{
+public:
+    quint16 address;
+    quint16 size; // Number of registers (or inputs) of the tag
+
+    QModbusTag();
+    QModbusTag(quint16 address, quint16 size = 1);
+};
+
+class QModbusReadBlock
+{
+public:
+    quint16 startAddress;
+    quint16 count;
+
+    QModbusReadBlock();
+    QModbusReadBlock(quint16 startAddress, quint16 count);
+};
+
+// Build the cheapest set of read requests covering a tag list, given the readable ranges of the device.
+// The cost of a request is requestCost + byteCost * (bytes sent + bytes received),
+// e.g. the round trip time and the time to transfer a byte on the link.
+class QModbusReadPlanner
+{
+    qreal requestCost;
+    qreal byteCost;
+
+public:
+    QModbusReadPlanner(qreal requestCost = 1000.0, qreal byteCost = 1.0);
+
+    void setCostModel(qreal requestCost, qreal byteCost);
+
+    qreal getBlockCost(quint8 functionCode, quint16 count) const;
+    qreal getPlanCost(quint8 functionCode, const QVector<QModbusReadBlock> & plan) const;
+
+    // Blocks are sorted by address and never span a hole or a boundary of the map nor exceed its max block size.
+    // Tags outside of the readable ranges are returned in unplannableTags.
+    QVector<QModbusReadBlock> plan(const QModbusAddressSpaceMap & map, QVector<QModbusTag> tags, QVector<QModbusTag> * unplannableTags = nullptr) const;
+};
+
+#endif // QModbusReadPlanner_H
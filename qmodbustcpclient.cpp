@@ -1,15 +1,18 @@
 #include "qmodbustcpclient.h"
+#include "qmodbusframe.h"
 #include <QDebug>
-#include <QtMath>
+#include <QRandomGenerator>
 
-#define LENGTH_IDX 4
-#define UNIT_IDENTIFIER_IDX 6
-#define FUNCTION_IDX 7
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
 
 ModbusRequest::ModbusRequest(QModbusTcpClient * client, quint16 transactionId)
 {
     this->client = client;
     this->transactionId = transactionId;
+    this->sent = false;
+    this->ageTimer.start();
 }
 
 quint16 ModbusRequest::getTransactionId()
@@ -17,6 +20,54 @@ quint16 ModbusRequest::getTransactionId()
     return this->transactionId;
 }
 
+QByteArray ModbusRequest::getFrame()
+{
+    return this->frame;
+}
+
+void ModbusRequest::setFrame(QByteArray frame)
+{
+    this->frame = frame;
+}
+
+bool ModbusRequest::isSent()
+{
+    return this->sent;
+}
+
+void ModbusRequest::setSent(bool sent)
+{
+    this->sent = sent;
+    if(sent)
+    {
+        sentTimer.start();
+    }
+}
+
+qint64 ModbusRequest::getTimeSinceSent()
+{
+    return sent ? sentTimer.elapsed() : -1;
+}
+
+qint64 ModbusRequest::getAge()
+{
+    return ageTimer.elapsed();
+}
+
+void ModbusRequest::abortAndCallback()
+{
+    getClient()->onRequestAborted(getTransactionId(), getFunctionCode(), getAddress());
+}
+
+void ModbusRequest::exceptionAndCallback(quint8 exceptionCode)
+{
+    getClient()->onModbusException(getTransactionId(), getFunctionCode(), getAddress(), QModbusTcpClient::toExceptionCode(exceptionCode));
+}
+
+void ModbusRequest::cancelAndCallback()
+{
+}
+
 ModbusRequest::~ModbusRequest() {}
 
 // FC6 :
@@ -30,16 +81,16 @@ WriteSingleWordFC6Request::WriteSingleWordFC6Request(QModbusTcpClient * client,
 
 WriteSingleWordFC6Request::~WriteSingleWordFC6Request() {}
 
-void WriteSingleWordFC6Request::decodeAndCallback(QVector<unsigned char> extractedData)
+void WriteSingleWordFC6Request::decodeAndCallback(const unsigned char * sentence, int length)
 {
-    quint16 protocolId = (extractedData[2] << 8) | extractedData[3];
-    quint8 unitIdentifier = extractedData[UNIT_IDENTIFIER_IDX];
-    quint8 functionCode = extractedData[FUNCTION_IDX];
+    quint16 protocolId = (sentence[2] << 8) | sentence[3];
+    quint8 unitIdentifier = sentence[UNIT_IDENTIFIER_IDX];
+    quint8 functionCode = sentence[FUNCTION_IDX];
 
-    if(functionCode == getFunctionCode())
+    if(functionCode == getFunctionCode() && length >= SINGLE_REQUEST_SIZE)
     {
-        quint16 address = (extractedData[8] << 8) | extractedData[9];
-        quint16 value = (extractedData[10] << 8) | extractedData[11];
+        quint16 address = ModbusFrame::getWord(&sentence[8]);
+        quint16 value = ModbusFrame::getWord(&sentence[10]);
 
         bool success = (wordAddress == address && wordValue == value);
         getClient()->onWriteSingleWordSentence(success, address, value);
@@ -59,25 +110,21 @@ ReadMultipleHoldingRegistersFC3Request::ReadMultipleHoldingRegistersFC3Request(Q
 
 ReadMultipleHoldingRegistersFC3Request::~ReadMultipleHoldingRegistersFC3Request() {}
 
-void ReadMultipleHoldingRegistersFC3Request::decodeAndCallback(QVector<unsigned char> extractedData)
+void ReadMultipleHoldingRegistersFC3Request::decodeAndCallback(const unsigned char * sentence, int length)
 {
-    quint16 protocolId = (extractedData[2] << 8) | extractedData[3];
-    quint8 unitIdentifier = extractedData[UNIT_IDENTIFIER_IDX];
-    quint8 functionCode = extractedData[FUNCTION_IDX];
+    quint16 protocolId = (sentence[2] << 8) | sentence[3];
+    quint8 unitIdentifier = sentence[UNIT_IDENTIFIER_IDX];
+    quint8 functionCode = sentence[FUNCTION_IDX];
 
     if(functionCode == getFunctionCode())
     {
-        quint8 numberOfDataBytes = extractedData[8];
-        quint8 numberOfWord = numberOfDataBytes / 2;
-
-        QVector<quint16> values;
+        QVector<quint16> values(sentence[8] / 2);
+        values.resize(ModbusFrame::decodeRegisters(sentence, length, values.data(), values.size()));
 
-        for(int i = 0; i < numberOfWord; i++)
+        for(int i = 0; i < values.size(); i++)
         {
-            int idx = 9 + (i * 2);
-            quint16 currentValue = (extractedData[idx] << 8) | extractedData[idx + 1];
-            values.push_back(currentValue);
-            getClient()->onReadMultipleHoldingRegistersSentenceSingleValue(startAddress + i, currentValue);
+            getClient()->updateHoldingRegisterCache(startAddress + i, values[i]);
+            getClient()->onReadMultipleHoldingRegistersSentenceSingleValue(startAddress + i, values[i]);
         }
 
         getClient()->onReadMultipleHoldingRegistersSentence(this->startAddress, values);
@@ -97,25 +144,21 @@ ReadMultipleInputRegistersFC4Request::ReadMultipleInputRegistersFC4Request(QModb
 
 ReadMultipleInputRegistersFC4Request::~ReadMultipleInputRegistersFC4Request() {}
 
-void ReadMultipleInputRegistersFC4Request::decodeAndCallback(QVector<unsigned char> extractedData)
+void ReadMultipleInputRegistersFC4Request::decodeAndCallback(const unsigned char * sentence, int length)
 {
-    quint16 protocolId = (extractedData[2] << 8) | extractedData[3];
-    quint8 unitIdentifier = extractedData[UNIT_IDENTIFIER_IDX];
-    quint8 functionCode = extractedData[FUNCTION_IDX];
+    quint16 protocolId = (sentence[2] << 8) | sentence[3];
+    quint8 unitIdentifier = sentence[UNIT_IDENTIFIER_IDX];
+    quint8 functionCode = sentence[FUNCTION_IDX];
 
     if(functionCode == getFunctionCode())
     {
-        quint8 numberOfDataBytes = extractedData[8];
-        quint8 numberOfWord = numberOfDataBytes / 2;
-
-        QVector<quint16> values;
+        QVector<quint16> values(sentence[8] / 2);
+        values.resize(ModbusFrame::decodeRegisters(sentence, length, values.data(), values.size()));
 
-        for(int i = 0; i < numberOfWord; i++)
+        for(int i = 0; i < values.size(); i++)
         {
-            int idx = 9 + (i * 2);
-            quint16 currentValue = (extractedData[idx] << 8) | extractedData[idx + 1];
-            values.push_back(currentValue);
-            getClient()->onReadMultipleInputRegistersSentenceSingleValue(startAddress + i, currentValue);
+            getClient()->updateInputRegisterCache(startAddress + i, values[i]);
+            getClient()->onReadMultipleInputRegistersSentenceSingleValue(startAddress + i, values[i]);
         }
 
         getClient()->onReadMultipleInputRegistersSentence(this->startAddress, values);
@@ -135,16 +178,16 @@ ForceSingleCoilsFC5Request::ForceSingleCoilsFC5Request(QModbusTcpClient * client
 
 ForceSingleCoilsFC5Request::~ForceSingleCoilsFC5Request() {}
 
-void ForceSingleCoilsFC5Request::decodeAndCallback(QVector<unsigned char> extractedData)
+void ForceSingleCoilsFC5Request::decodeAndCallback(const unsigned char * sentence, int length)
 {
-    quint16 protocolId = (extractedData[2] << 8) | extractedData[3];
-    quint8 unitIdentifier = extractedData[UNIT_IDENTIFIER_IDX];
-    quint8 functionCode = extractedData[FUNCTION_IDX];
+    quint16 protocolId = (sentence[2] << 8) | sentence[3];
+    quint8 unitIdentifier = sentence[UNIT_IDENTIFIER_IDX];
+    quint8 functionCode = sentence[FUNCTION_IDX];
 
-    if(functionCode == getFunctionCode())
+    if(functionCode == getFunctionCode() && length >= SINGLE_REQUEST_SIZE)
     {
-        quint16 address = (extractedData[8] << 8) | extractedData[9];
-        quint16 value = (extractedData[10] << 8) | extractedData[11];
+        quint16 address = ModbusFrame::getWord(&sentence[8]);
+        quint16 value = ModbusFrame::getWord(&sentence[10]);
 
 
         bool success = this->coilAddress == address && ((this->value && value == 0xFF00) || (!this->value && value == 0x0000));
@@ -165,16 +208,16 @@ ForceMultipleCoilsFC15Request::ForceMultipleCoilsFC15Request(QModbusTcpClient *
 
 ForceMultipleCoilsFC15Request::~ForceMultipleCoilsFC15Request() {}
 
-void ForceMultipleCoilsFC15Request::decodeAndCallback(QVector<unsigned char> extractedData)
+void ForceMultipleCoilsFC15Request::decodeAndCallback(const unsigned char * sentence, int length)
 {
-    quint16 protocolId = (extractedData[2] << 8) | extractedData[3];
-    quint8 unitIdentifier = extractedData[UNIT_IDENTIFIER_IDX];
-    quint8 functionCode = extractedData[FUNCTION_IDX];
+    quint16 protocolId = (sentence[2] << 8) | sentence[3];
+    quint8 unitIdentifier = sentence[UNIT_IDENTIFIER_IDX];
+    quint8 functionCode = sentence[FUNCTION_IDX];
 
-    if(functionCode == getFunctionCode())
+    if(functionCode == getFunctionCode() && length >= SINGLE_REQUEST_SIZE)
     {
-        quint16 address = (extractedData[8] << 8) | extractedData[9];
-        quint16 numberOfCoilsWritten = (extractedData[10] << 8) | extractedData[11];
+        quint16 address = ModbusFrame::getWord(&sentence[8]);
+        quint16 numberOfCoilsWritten = ModbusFrame::getWord(&sentence[10]);
 
         bool success = this->startAddress == address && this->values.size() == numberOfCoilsWritten;
         getClient()->onForceMultipleCoilsSentence(success, startAddress, values, numberOfCoilsWritten);
@@ -194,33 +237,16 @@ ReadMultipleInputsStatusFC2Request::ReadMultipleInputsStatusFC2Request(QModbusTc
 
 ReadMultipleInputsStatusFC2Request::~ReadMultipleInputsStatusFC2Request() {}
 
-void ReadMultipleInputsStatusFC2Request::decodeAndCallback(QVector<unsigned char> extractedData)
+void ReadMultipleInputsStatusFC2Request::decodeAndCallback(const unsigned char * sentence, int length)
 {
-    quint16 protocolId = (extractedData[2] << 8) | extractedData[3];
-    quint8 unitIdentifier = extractedData[UNIT_IDENTIFIER_IDX];
-    quint8 functionCode = extractedData[FUNCTION_IDX];
+    quint16 protocolId = (sentence[2] << 8) | sentence[3];
+    quint8 unitIdentifier = sentence[UNIT_IDENTIFIER_IDX];
+    quint8 functionCode = sentence[FUNCTION_IDX];
 
     if(functionCode == getFunctionCode())
     {
-        quint8 nbByteToRead = extractedData[8];
-        QVector<bool> values;
-
-        int nbBitRead = 0;
-        for(int i = 0; i < nbByteToRead; i++)
-        {
-            for(int j = 0; j < 8; j++)
-            {
-                if(nbBitRead < nbInputs)
-                {
-                    values.push_back(QModbusTcpClient::getBit(extractedData[9 + i], j));
-                    nbBitRead++;
-                }
-                else
-                {
-                    break;
-                }
-            }
-        }
+        QVector<bool> values(nbInputs);
+        values.resize(ModbusFrame::decodeBits(sentence, length, values.data(), values.size()));
 
         getClient()->onReadMultipleInputsStatusSentence(startAddress, values);
     }
@@ -239,16 +265,16 @@ PresetMultipleRegisterFC16Request::PresetMultipleRegisterFC16Request(QModbusTcpC
 
 PresetMultipleRegisterFC16Request::~PresetMultipleRegisterFC16Request() {}
 
-void PresetMultipleRegisterFC16Request::decodeAndCallback(QVector<unsigned char> extractedData)
+void PresetMultipleRegisterFC16Request::decodeAndCallback(const unsigned char * sentence, int length)
 {
-    quint16 protocolId = (extractedData[2] << 8) | extractedData[3];
-    quint8 unitIdentifier = extractedData[UNIT_IDENTIFIER_IDX];
-    quint8 functionCode = extractedData[FUNCTION_IDX];
+    quint16 protocolId = (sentence[2] << 8) | sentence[3];
+    quint8 unitIdentifier = sentence[UNIT_IDENTIFIER_IDX];
+    quint8 functionCode = sentence[FUNCTION_IDX];
 
-    if(functionCode == getFunctionCode())
+    if(functionCode == getFunctionCode() && length >= SINGLE_REQUEST_SIZE)
     {
-        quint16 address = (extractedData[8] << 8) | extractedData[9];
-        quint16 numberOfRegistersWritten = (extractedData[10] << 8) | extractedData[11];
+        quint16 address = ModbusFrame::getWord(&sentence[8]);
+        quint16 numberOfRegistersWritten = ModbusFrame::getWord(&sentence[10]);
 
         bool success = this->startAddress == address && this->values.size() == numberOfRegistersWritten;
         getClient()->onPresetMultipleRegistersSentence(success, startAddress, values, numberOfRegistersWritten);
@@ -258,19 +284,705 @@ void PresetMultipleRegisterFC16Request::decodeAndCallback(QVector<unsigned char>
     }
 }
 
+// Bulk chunk :
+BulkChunkRequest::BulkChunkRequest(QModbusTcpClient * client, quint16 transactionId, quint8 functionCode, quint32 transferId, quint16 startAddress, quint16 count, quint16 * destination)
+    : ModbusRequest (client, transactionId)
+{
+    this->functionCode = functionCode;
+    this->transferId = transferId;
+    this->startAddress = startAddress;
+    this->count = count;
+    this->destination = destination;
+}
+
+BulkChunkRequest::~BulkChunkRequest() {}
+
+void BulkChunkRequest::decodeAndCallback(const unsigned char * sentence, int length)
+{
+    quint8 functionCode = sentence[FUNCTION_IDX];
+    bool success = false;
+
+    if(functionCode != getFunctionCode())
+    {
+        qDebug() << "BulkChunkRequest::decodeAndCallback - Received an incoherent sentence to request.";
+    }
+    else if(functionCode == 0x03 || functionCode == 0x04)
+    {
+        quint8 numberOfDataBytes = sentence[8];
+        success = (numberOfDataBytes == 2 * count && length >= 9 + numberOfDataBytes);
+
+        if(success)
+        {
+            ModbusFrame::decodeRegisters(sentence, length, destination, count);
+
+            // Keep the cache as fresh as after a plain FC3 / FC4 read :
+            for(int i = 0; i < count; i++)
+            {
+                if(functionCode == 0x03)
+                {
+                    getClient()->updateHoldingRegisterCache(startAddress + i, destination[i]);
+                }
+                else
+                {
+                    getClient()->updateInputRegisterCache(startAddress + i, destination[i]);
+                }
+            }
+        }
+    }
+    else if(length < SINGLE_REQUEST_SIZE)
+    {
+        qDebug() << "BulkChunkRequest::decodeAndCallback - Received a truncated write response.";
+    }
+    else
+    {
+        quint16 address = ModbusFrame::getWord(&sentence[8]);
+        quint16 numberWritten = ModbusFrame::getWord(&sentence[10]);
+        success = (startAddress == address && count == numberWritten);
+    }
+
+    getClient()->onBulkChunkFinished(transferId, success);
+}
+
+void BulkChunkRequest::abortAndCallback()
+{
+    getClient()->onBulkChunkFinished(transferId, false);
+}
+
+void BulkChunkRequest::cancelAndCallback()
+{
+    // The transfer waits for every chunk it sent :
+    getClient()->onBulkChunkFinished(transferId, false);
+}
+
+void BulkChunkRequest::exceptionAndCallback(quint8 exceptionCode)
+{
+    // The exception code tells an illegal address from a busy device, the transfer result alone doesn't :
+    ModbusRequest::exceptionAndCallback(exceptionCode);
+    getClient()->onBulkChunkFinished(transferId, false);
+}
+
 // ModbusClient :
 QModbusTcpClient::QModbusTcpClient(QString host, quint16 port, QObject *parent) : QTcpSocket(parent)
 {
     this->transactionId = 1;
+    this->respondingTransactionId = 0;
+    this->processingSentences = false;
+    this->bufferReset = false;
     this->host = host;
+    this->activeHost = host;
     this->port = port;
     this->unitId = 0;
+
+    this->autoReconnect = false;
+    this->userDisconnected = false;
+    this->wasConnected = false;
+    this->pendingRequestPolicy = ReplayPendingRequests;
+    this->reconnectInitialDelay = 100;
+    this->reconnectMaxDelay = 5000;
+    this->connectTimeout = 2000;
+    this->responseTimeout = 5000;
+    this->maxRequestAge = 10000;
+    this->reconnectAttempt = 0;
+
+    this->dataGapPending = false;
+    this->lastReconnectTime = -1;
+    this->lastDataGap = -1;
+    this->reconnectCount = 0;
+
+    resetExceptionCounters();
+    this->exceptionBackoffInitialDelay = 50;
+    this->exceptionBackoffMaxDelay = 2000;
+    this->exceptionBackoffStep = 0;
+
+    this->nextBulkTransferId = 1;
+    this->maxInFlightRequests = 8;
+
+    reconnectTimer.setSingleShot(true);
+    connectTimer.setSingleShot(true);
+    responseTimer.setSingleShot(true);
+    sendHoldTimer.setSingleShot(true);
+
     QObject::connect(this, SIGNAL(readyRead()), this, SLOT(onDataRecv()));
+    QObject::connect(this, SIGNAL(stateChanged(QAbstractSocket::SocketState)), this, SLOT(onSocketStateChanged(QAbstractSocket::SocketState)));
+    QObject::connect(&reconnectTimer, SIGNAL(timeout()), this, SLOT(onReconnectTimeout()));
+    QObject::connect(&connectTimer, SIGNAL(timeout()), this, SLOT(onConnectTimeout()));
+    QObject::connect(&responseTimer, SIGNAL(timeout()), this, SLOT(onResponseTimeout()));
+    QObject::connect(&sendHoldTimer, SIGNAL(timeout()), this, SLOT(onSendHoldTimeout()));
+}
+
+QModbusTcpClient::~QModbusTcpClient()
+{
+    qDeleteAll(pendingRequests);
+    pendingRequests.clear();
 }
 
 void QModbusTcpClient::connectToHost()
 {
-    QTcpSocket::connectToHost(host, port);
+    userDisconnected = false;
+    reconnectAttempt = 0;
+    reconnectTimer.stop();
+    startConnectAttempt();
+}
+
+void QModbusTcpClient::disconnectFromHost()
+{
+    userDisconnected = true;
+    reconnectTimer.stop();
+    connectTimer.stop();
+    clearProbes();
+    QTcpSocket::disconnectFromHost();
+}
+
+void QModbusTcpClient::addRedundantHost(QString host)
+{
+    redundantHosts.push_back(host);
+}
+
+QString QModbusTcpClient::getActiveHost()
+{
+    return activeHost;
+}
+
+void QModbusTcpClient::setAutoReconnect(bool enabled)
+{
+    autoReconnect = enabled;
+    if(!enabled)
+    {
+        reconnectTimer.stop();
+    }
+    startResponseTimer();
+}
+
+void QModbusTcpClient::setReconnectBackoff(int initialDelayMs, int maxDelayMs)
+{
+    reconnectInitialDelay = qMax(1, initialDelayMs);
+    reconnectMaxDelay = qMax(reconnectInitialDelay, maxDelayMs);
+}
+
+void QModbusTcpClient::setConnectTimeout(int timeoutMs)
+{
+    connectTimeout = timeoutMs;
+}
+
+void QModbusTcpClient::setResponseTimeout(int timeoutMs)
+{
+    responseTimeout = timeoutMs;
+    startResponseTimer();
+}
+
+void QModbusTcpClient::setPendingRequestPolicy(PendingRequestPolicy policy)
+{
+    pendingRequestPolicy = policy;
+}
+
+void QModbusTcpClient::setMaxRequestAge(int maxAgeMs)
+{
+    maxRequestAge = maxAgeMs;
+}
+
+bool QModbusTcpClient::getCachedHoldingRegister(quint16 address, quint16 *value)
+{
+    QHash<quint16, quint16>::const_iterator it = holdingRegistersCache.constFind(address);
+    if(it == holdingRegistersCache.constEnd())
+    {
+        return false;
+    }
+
+    *value = it.value();
+    return true;
+}
+
+bool QModbusTcpClient::getCachedInputRegister(quint16 address, quint16 *value)
+{
+    QHash<quint16, quint16>::const_iterator it = inputRegistersCache.constFind(address);
+    if(it == inputRegistersCache.constEnd())
+    {
+        return false;
+    }
+
+    *value = it.value();
+    return true;
+}
+
+void QModbusTcpClient::clearRegisterCache()
+{
+    holdingRegistersCache.clear();
+    inputRegistersCache.clear();
+}
+
+void QModbusTcpClient::updateHoldingRegisterCache(quint16 address, quint16 value)
+{
+    holdingRegistersCache[address] = value;
+}
+
+void QModbusTcpClient::updateInputRegisterCache(quint16 address, quint16 value)
+{
+    inputRegistersCache[address] = value;
+}
+
+qint64 QModbusTcpClient::getLastReconnectTime()
+{
+    return lastReconnectTime;
+}
+
+qint64 QModbusTcpClient::getLastDataGap()
+{
+    return lastDataGap;
+}
+
+quint32 QModbusTcpClient::getReconnectCount()
+{
+    return reconnectCount;
+}
+
+QModbusTcpClient::ExceptionCode QModbusTcpClient::toExceptionCode(quint8 exceptionCode)
+{
+    switch(exceptionCode)
+    {
+    case IllegalFunction:
+    case IllegalDataAddress:
+    case IllegalDataValue:
+    case SlaveDeviceFailure:
+    case Acknowledge:
+    case SlaveDeviceBusy:
+    case NegativeAcknowledge:
+    case MemoryParityError:
+    case GatewayPathUnavailable:
+    case GatewayTargetFailedToRespond:
+        return (ExceptionCode)exceptionCode;
+    default:
+        return UnknownException;
+    }
+}
+
+quint32 QModbusTcpClient::getExceptionCount(ExceptionCode exceptionCode)
+{
+    return exceptionCounters[exceptionCode];
+}
+
+bool QModbusTcpClient::isHoldingSends()
+{
+    return sendHoldTimer.isActive();
+}
+
+void QModbusTcpClient::resetExceptionCounters()
+{
+    for(int i = 0; i <= GatewayTargetFailedToRespond; i++)
+    {
+        exceptionCounters[i] = 0;
+    }
+}
+
+void QModbusTcpClient::setExceptionBackoff(int initialDelayMs, int maxDelayMs)
+{
+    exceptionBackoffInitialDelay = qMax(0, initialDelayMs);
+    exceptionBackoffMaxDelay = qMax(exceptionBackoffInitialDelay, maxDelayMs);
+}
+
+void QModbusTcpClient::onExceptionReceived(quint8 exceptionCode)
+{
+    ExceptionCode code = toExceptionCode(exceptionCode);
+    exceptionCounters[code]++;
+
+    if(isSendHoldException(code))
+    {
+        int delay = getExceptionHoldDelay(exceptionBackoffInitialDelay, exceptionBackoffMaxDelay, exceptionBackoffStep);
+        if(exceptionBackoffStep < 16)
+        {
+            exceptionBackoffStep++;
+        }
+
+        if(delay > 0)
+        {
+            sendHoldTimer.start(delay);
+            emit onSendHold(delay);
+        }
+    }
+}
+
+int QModbusTcpClient::getReconnectDelay(int initialDelayMs, int maxDelayMs, int attempt)
+{
+    if(attempt <= 0)
+    {
+        return 0;
+    }
+
+    int ceiling = (int)qMin<qint64>(maxDelayMs, (qint64)initialDelayMs << qMin(attempt - 1, 16));
+    return ceiling / 2 + QRandomGenerator::global()->bounded(ceiling / 2 + 1);
+}
+
+int QModbusTcpClient::getExceptionHoldDelay(int initialDelayMs, int maxDelayMs, int step)
+{
+    return (int)qMin<qint64>(maxDelayMs, (qint64)initialDelayMs << qBound(0, step, 16));
+}
+
+bool QModbusTcpClient::isSendHoldException(ExceptionCode exceptionCode)
+{
+    return exceptionCode == SlaveDeviceBusy || exceptionCode == GatewayPathUnavailable || exceptionCode == GatewayTargetFailedToRespond;
+}
+
+void QModbusTcpClient::onSendHoldTimeout()
+{
+    if(state() == QAbstractSocket::ConnectedState)
+    {
+        sendUnsentRequests();
+    }
+}
+
+void QModbusTcpClient::startConnectAttempt()
+{
+    clearProbes();
+
+    if(redundantHosts.isEmpty())
+    {
+        activeHost = host;
+        QTcpSocket::connectToHost(activeHost, port);
+    }
+    else
+    {
+        // Race every known address of the device, the first one to accept wins :
+        QStringList candidates;
+        candidates << host << redundantHosts;
+        for(int i = 0; i < candidates.size(); i++)
+        {
+            QTcpSocket * probe = new QTcpSocket(this);
+            QObject::connect(probe, SIGNAL(connected()), this, SLOT(onProbeConnected()));
+            QObject::connect(probe, SIGNAL(stateChanged(QAbstractSocket::SocketState)), this, SLOT(onProbeStateChanged(QAbstractSocket::SocketState)));
+            probes.push_back(probe);
+            probe->connectToHost(candidates[i], port);
+        }
+    }
+
+    if(autoReconnect && connectTimeout > 0)
+    {
+        connectTimer.start(connectTimeout);
+    }
+}
+
+void QModbusTcpClient::scheduleReconnect()
+{
+    if(!autoReconnect || userDisconnected || reconnectTimer.isActive())
+    {
+        return;
+    }
+
+    int delay = getReconnectDelay(reconnectInitialDelay, reconnectMaxDelay, reconnectAttempt);
+    reconnectAttempt++;
+    reconnectTimer.start(delay);
+}
+
+void QModbusTcpClient::clearProbes()
+{
+    for(int i = 0; i < probes.size(); i++)
+    {
+        probes[i]->disconnect(this);
+        probes[i]->abort();
+        probes[i]->deleteLater();
+    }
+    probes.clear();
+}
+
+void QModbusTcpClient::onReconnectTimeout()
+{
+    startConnectAttempt();
+}
+
+void QModbusTcpClient::onConnectTimeout()
+{
+    if(!probes.isEmpty())
+    {
+        clearProbes();
+        scheduleReconnect();
+    }
+    else if(state() != QAbstractSocket::ConnectedState)
+    {
+        QTcpSocket::abort();
+        scheduleReconnect();
+    }
+}
+
+void QModbusTcpClient::onProbeConnected()
+{
+    QTcpSocket * winner = qobject_cast<QTcpSocket*>(sender());
+    if(winner == nullptr)
+    {
+        return;
+    }
+
+    activeHost = winner->peerName();
+
+#ifdef Q_OS_UNIX
+    // Adopt the winning connection as transport, its probe socket only releases its own descriptor :
+    int descriptor = ::dup(winner->socketDescriptor());
+    clearProbes();
+
+    if(descriptor >= 0)
+    {
+        if(setSocketDescriptor(descriptor))
+        {
+            return;
+        }
+        ::close(descriptor);
+    }
+#else
+    clearProbes();
+#endif
+
+    // Fallback : open a new connection on the address known to be reachable.
+    QTcpSocket::connectToHost(activeHost, port);
+}
+
+void QModbusTcpClient::onProbeStateChanged(QAbstractSocket::SocketState state)
+{
+    if(state != QAbstractSocket::UnconnectedState)
+    {
+        return;
+    }
+
+    for(int i = 0; i < probes.size(); i++)
+    {
+        if(probes[i]->state() != QAbstractSocket::UnconnectedState)
+        {
+            return;
+        }
+    }
+
+    // Every address refused the connection :
+    connectTimer.stop();
+    clearProbes();
+    scheduleReconnect();
+}
+
+void QModbusTcpClient::onSocketStateChanged(QAbstractSocket::SocketState state)
+{
+    if(state == QAbstractSocket::ConnectedState)
+    {
+        connectTimer.stop();
+        onConnectionEstablished();
+    }
+    else if(state == QAbstractSocket::UnconnectedState)
+    {
+        if(wasConnected)
+        {
+            onConnectionLost();
+        }
+
+        if(probes.isEmpty())
+        {
+            scheduleReconnect();
+        }
+    }
+}
+
+void QModbusTcpClient::onConnectionEstablished()
+{
+    wasConnected = true;
+
+    if(disconnectTimer.isValid())
+    {
+        lastReconnectTime = disconnectTimer.elapsed();
+        reconnectCount++;
+        dataGapPending = lastDataTimer.isValid();
+        disconnectTimer.invalidate();
+        emit onReconnected(lastReconnectTime);
+    }
+
+    reconnectAttempt = 0;
+
+    // Lets the system notice a dead peer even when no request is pending :
+    setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+
+    sendUnsentRequests();
+}
+
+void QModbusTcpClient::onConnectionLost()
+{
+    wasConnected = false;
+    disconnectTimer.start();
+    responseTimer.stop();
+
+    // A partial sentence can't be completed by the next connection :
+    buffer.clear();
+    bufferReset = true;
+
+    if(pendingRequestPolicy == AbortPendingRequests)
+    {
+        abortPendingRequests();
+    }
+    else
+    {
+        QMap<quint16, ModbusRequest*>::iterator it;
+        for(it = pendingRequests.begin(); it != pendingRequests.end(); ++it)
+        {
+            it.value()->setSent(false);
+        }
+    }
+}
+
+void QModbusTcpClient::sendRequest(ModbusRequest *request, QByteArray frame)
+{
+    request->setFrame(frame);
+
+    if(request->getTransactionId() == 0)
+    {
+        qDebug() << "QModbusTcpClient::sendRequest - Every transaction id is pending ... Operation aborted.";
+        request->abortAndCallback();
+        delete request;
+        return;
+    }
+
+    if(state() == QAbstractSocket::ConnectedState && !sendHoldTimer.isActive())
+    {
+        pendingRequests[request->getTransactionId()] = request;
+        writeRequest(request);
+    }
+    else
+    {
+        // The queue only grows while the request can't be written, drop what is already stale :
+        abortExpiredRequests();
+        pendingRequests[request->getTransactionId()] = request;
+    }
+}
+
+void QModbusTcpClient::writeRequest(ModbusRequest *request)
+{
+    write(request->getFrame());
+    flush();
+    request->setSent(true);
+
+    if(!responseTimer.isActive())
+    {
+        startResponseTimer();
+    }
+
+    emit onRequestSent(request->getTransactionId());
+}
+
+void QModbusTcpClient::startResponseTimer()
+{
+    responseTimer.stop();
+    if(!autoReconnect || responseTimeout <= 0 || state() != QAbstractSocket::ConnectedState)
+    {
+        return;
+    }
+
+    // Armed for the request waiting the longest :
+    qint64 oldest = -1;
+    QMap<quint16, ModbusRequest*>::iterator it;
+    for(it = pendingRequests.begin(); it != pendingRequests.end(); ++it)
+    {
+        oldest = qMax(oldest, it.value()->getTimeSinceSent());
+    }
+
+    if(oldest >= 0)
+    {
+        responseTimer.start((int)qMax<qint64>(0, responseTimeout - oldest));
+    }
+}
+
+void QModbusTcpClient::onResponseTimeout()
+{
+    qint64 oldest = -1;
+    QMap<quint16, ModbusRequest*>::iterator it;
+    for(it = pendingRequests.begin(); it != pendingRequests.end(); ++it)
+    {
+        oldest = qMax(oldest, it.value()->getTimeSinceSent());
+    }
+
+    if(state() == QAbstractSocket::ConnectedState && oldest >= responseTimeout)
+    {
+        // The link is considered lost, the usual loss path replays or aborts the pending requests :
+        qDebug() << "QModbusTcpClient::onResponseTimeout - No response from the device, dropping the connection.";
+        abort();
+    }
+    else
+    {
+        startResponseTimer();
+    }
+}
+
+bool QModbusTcpClient::cancelRequest(quint16 transactionId)
+{
+    ModbusRequest * request = pendingRequests.value(transactionId, nullptr);
+    if(request == nullptr)
+    {
+        return false;
+    }
+
+    pendingRequests.remove(transactionId);
+    request->cancelAndCallback();
+    delete request;
+    startResponseTimer();
+    pumpBulkTransfers();
+    return true;
+}
+
+quint16 QModbusTcpClient::getRespondingTransactionId()
+{
+    return respondingTransactionId;
+}
+
+void QModbusTcpClient::sendUnsentRequests()
+{
+    if(sendHoldTimer.isActive())
+    {
+        return;
+    }
+
+    abortExpiredRequests();
+
+    QMap<quint16, ModbusRequest*>::iterator it;
+    for(it = pendingRequests.begin(); it != pendingRequests.end(); ++it)
+    {
+        if(!it.value()->isSent())
+        {
+            writeRequest(it.value());
+        }
+    }
+}
+
+void QModbusTcpClient::abortExpiredRequests()
+{
+    if(maxRequestAge <= 0)
+    {
+        return;
+    }
+
+    QList<ModbusRequest*> expired;
+    QMap<quint16, ModbusRequest*>::iterator it = pendingRequests.begin();
+    while(it != pendingRequests.end())
+    {
+        if(!it.value()->isSent() && it.value()->getAge() > maxRequestAge)
+        {
+            expired.push_back(it.value());
+            it = pendingRequests.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    for(int i = 0; i < expired.size(); i++)
+    {
+        expired[i]->abortAndCallback();
+        delete expired[i];
+    }
+}
+
+void QModbusTcpClient::abortPendingRequests()
+{
+    QMap<quint16, ModbusRequest*> requests = pendingRequests;
+    pendingRequests.clear();
+
+    QMap<quint16, ModbusRequest*>::iterator it;
+    for(it = requests.begin(); it != requests.end(); ++it)
+    {
+        it.value()->abortAndCallback();
+        delete it.value();
+    }
+
+    pumpBulkTransfers();
 }
 
 void QModbusTcpClient::onDataRecv()
@@ -279,269 +991,355 @@ void QModbusTcpClient::onDataRecv()
 
     while(bytesAvailable() > 0)
     {
-        QByteArray receivedData = read(64);
-        for(int i = 0; i < receivedData.size(); i++)
+        // Read straight at the end of the buffer :
+        int bufferSize = buffer.size();
+        buffer.resize(bufferSize + bytesAvailable());
+        qint64 readSize = read(buffer.data() + bufferSize, buffer.size() - bufferSize);
+        buffer.resize(bufferSize + qMax<qint64>(readSize, 0));
+
+        if(readSize <= 0)
         {
-            buffer.push_back(receivedData[i]);
-            hasReceivedData = true;
+            break;
         }
+        hasReceivedData = true;
     }
 
     if(hasReceivedData)
     {
+        if(dataGapPending)
+        {
+            dataGapPending = false;
+            lastDataGap = lastDataTimer.elapsed();
+            emit onDataGap(lastDataGap);
+        }
+        lastDataTimer.start();
+
         processModbusSentence();
     }
 }
 
 void QModbusTcpClient::processModbusSentence()
 {
+    // A slot waiting for more data comes back here through onDataRecv, the running loop handles the new bytes :
+    if(processingSentences)
+    {
+        return;
+    }
+    processingSentences = true;
+
     bool hasDataToProcess = true;
 
     while(hasDataToProcess)
     {
-        if(buffer.size() >= 6)
+        int totalLength = ModbusFrame::getSentenceLength(buffer.constData(), buffer.size());
+        if(totalLength > 0)
         {
-            int dataSize = (buffer[LENGTH_IDX] << 8) | buffer[LENGTH_IDX + 1];
-            int totalLength = 6 + dataSize;
-
             if(buffer.size() < totalLength)
             {
                 hasDataToProcess = false;
             }
+            else if(totalLength < 9)
+            {
+                qDebug() << "Received a sentence too short to be decoded ...";
+                buffer.remove(0, totalLength);
+            }
             else {
-                QVector<unsigned char> extractedData;
-                for(int i = 0; i < totalLength; i++)
-                {
-                    extractedData.push_back(buffer.front());
-                    buffer.pop_front();
-                }
-
-                quint16 transactionId = (extractedData[0] << 8) | extractedData[1];
+                // Decoded in place, the sentence is removed from the buffer once handled :
+                const unsigned char * sentence = (const unsigned char *)buffer.constData();
+                quint16 transactionId = ModbusFrame::getTransactionId(sentence);
+                bufferReset = false;
 
                 if(pendingRequests.contains(transactionId))
                 {
                     ModbusRequest * request = pendingRequests[transactionId];
                     pendingRequests.remove(transactionId);
-                    request->decodeAndCallback(extractedData);
+
+                    respondingTransactionId = transactionId;
+                    if(ModbusFrame::isException(sentence, totalLength, request->getFunctionCode()))
+                    {
+                        quint8 exceptionCode = ModbusFrame::getExceptionCode(sentence);
+                        onExceptionReceived(exceptionCode);
+                        request->exceptionAndCallback(exceptionCode);
+                    }
+                    else
+                    {
+                        exceptionBackoffStep = 0;
+                        request->decodeAndCallback(sentence, totalLength);
+                    }
+                    respondingTransactionId = 0;
                     delete request;
                 }
                 else {
                     qDebug() << "Received sentence to unknown request ...";
                 }
+
+                // A slot which dropped the connection already cleared the buffer :
+                if(bufferReset)
+                {
+                    hasDataToProcess = false;
+                }
+                else
+                {
+                    buffer.remove(0, totalLength);
+                }
             }
         }
         else {
             hasDataToProcess = false;
         }
     }
+
+    processingSentences = false;
+
+    startResponseTimer();
+
+    // Completed requests of any kind free room for bulk chunks :
+    pumpBulkTransfers();
 }
 
-bool QModbusTcpClient::getBit(char byte, int bitNumber)
+quint16 QModbusTcpClient::nextTransactionId()
 {
-    quint8 value = (byte >> bitNumber) & 0x01;
-    return value != 0;
+    // 0 means "no request" to the callers, and an id still pending would replace its request :
+    for(int i = 0; i < 0x10000; i++)
+    {
+        quint16 id = transactionId;
+        transactionId++;
+
+        if(id != 0 && !pendingRequests.contains(id))
+        {
+            return id;
+        }
+    }
+    return 0;
 }
 
-void QModbusTcpClient::setBit(char * byte, int bitNumber, bool value)
+quint16 QModbusTcpClient::writeSingleWordFC6(quint16 wordAddress, quint16 wordValue)
 {
-    quint8 mask = (1 << bitNumber);
-    quint8 orValue = 0 + (value ? mask : 0);
-    *byte |= orValue;
+    char trame[SINGLE_REQUEST_SIZE];
+    quint16 id = nextTransactionId();
+    int length = ModbusFrame::encodeRequest(trame, id, unitId, 0x06, wordAddress, wordValue);
+
+    sendRequest(new WriteSingleWordFC6Request(this, id, wordAddress, wordValue), QByteArray(trame, length));
+    return id;
 }
 
-char QModbusTcpClient::getMSB(quint16 value)
+quint16 QModbusTcpClient::readMultipleHoldingRegistersFC3(quint16 startAddress, quint16 nbWord)
 {
-    return (value & 0xFF00) >> 8;
+    char trame[SINGLE_REQUEST_SIZE];
+    quint16 id = nextTransactionId();
+    int length = ModbusFrame::encodeRequest(trame, id, unitId, 0x03, startAddress, nbWord);
+
+    sendRequest(new ReadMultipleHoldingRegistersFC3Request(this, id, startAddress, nbWord), QByteArray(trame, length));
+    return id;
 }
 
-char QModbusTcpClient::getLSB(quint16 value)
+quint16 QModbusTcpClient::readMultipleInputRegistersFC4(quint16 startAddress, quint16 nbWord)
 {
-    return (value & 0x00FF);
+    char trame[SINGLE_REQUEST_SIZE];
+    quint16 id = nextTransactionId();
+    int length = ModbusFrame::encodeRequest(trame, id, unitId, 0x04, startAddress, nbWord);
+
+    sendRequest(new ReadMultipleInputRegistersFC4Request(this, id, startAddress, nbWord), QByteArray(trame, length));
+    return id;
 }
 
-quint16 QModbusTcpClient::setTransactionId(char *ptr)
+quint16 QModbusTcpClient::forceSingleCoilFC5(quint16 coilAddress, bool value)
 {
-    quint16 id = transactionId;
-    ptr[0] = getMSB(transactionId);
-    ptr[1] = getLSB(transactionId);
-    transactionId++;
+    char trame[SINGLE_REQUEST_SIZE];
+    quint16 id = nextTransactionId();
+    int length = ModbusFrame::encodeRequest(trame, id, unitId, 0x05, coilAddress, value ? 0xFF00 : 0x0000);
+
+    sendRequest(new ForceSingleCoilsFC5Request(this, id, coilAddress, value), QByteArray(trame, length));
     return id;
 }
 
-void QModbusTcpClient::setProtocolId(char *ptr)
+quint16 QModbusTcpClient::forceMultipleCoilsFC15(quint16 startAddress, QVector<bool> values)
 {
-    ptr[0] = 0x00;
-    ptr[1] = 0x00;
+    if(values.isEmpty() || values.size() > 1968)
+    {
+        qDebug() << "QModbusTcpClient::forceMultipleCoilsFC15 - A request writes 1 to 1968 coils, use forceCoilsBulk for more ... Operation aborted.";
+        return 0;
+    }
+    else {
+        QByteArray frame(ModbusFrame::getForceMultipleCoilsSize(values.size()), '\0');
+        quint16 id = nextTransactionId();
+        ModbusFrame::encodeForceMultipleCoils(frame.data(), id, unitId, startAddress, values.constData(), values.size());
+
+        sendRequest(new ForceMultipleCoilsFC15Request(this, id, startAddress, values), frame);
+        return id;
+    }
 }
 
-void QModbusTcpClient::setLength(char *ptr, quint16 len)
+quint16 QModbusTcpClient::readMultipleInputsStatusFC2(quint16 startAddress, quint16 nbInput)
 {
-    ptr[0] = getMSB(len);
-    ptr[1] = getLSB(len);
+    char trame[SINGLE_REQUEST_SIZE];
+    quint16 id = nextTransactionId();
+    int length = ModbusFrame::encodeRequest(trame, id, unitId, 0x02, startAddress, nbInput);
+
+    sendRequest(new ReadMultipleInputsStatusFC2Request(this, id, startAddress, nbInput), QByteArray(trame, length));
+    return id;
 }
 
-void QModbusTcpClient::setUnitId(char *ptr, quint8 unitId)
+quint16 QModbusTcpClient::presetMultipleRegistersFC16(quint16 startAddress, QVector<quint16> values)
 {
-    ptr[0] = unitId;
+    if(values.isEmpty() || values.size() > 123)
+    {
+        qDebug() << "QModbusTcpClient::presetMultipleRegistersFC16 - A request writes 1 to 123 registers, use presetRegistersBulk for more ... Operation aborted.";
+        return 0;
+    }
+    else
+    {
+        QByteArray frame(ModbusFrame::getPresetMultipleRegistersSize(values.size()), '\0');
+        quint16 id = nextTransactionId();
+        ModbusFrame::encodePresetMultipleRegisters(frame.data(), id, unitId, startAddress, values.constData(), values.size());
+
+        sendRequest(new PresetMultipleRegisterFC16Request(this, id, startAddress, values), frame);
+        return id;
+    }
 }
 
-void QModbusTcpClient::setFunctionCode(char *ptr, quint8 functionCode)
+quint16 QModbusTcpClient::getBulkChunkSize(quint8 functionCode)
 {
-    ptr[0] = functionCode;
+    switch(functionCode)
+    {
+    case 0x03:
+    case 0x04:
+        return 125;
+    case 0x0F:
+        return 1968;
+    case 0x10:
+        return 123;
+    default:
+        return 0;
+    }
 }
 
-quint16 QModbusTcpClient::setHeader(char *ptr, quint16 length, quint8 unitId, quint8 functionCode)
+void QModbusTcpClient::setMaxInFlightRequests(int maxInFlightRequests)
 {
-    quint16 id = setTransactionId(&ptr[0]);
-    setProtocolId(&ptr[2]);
-    setLength(&ptr[4], length);
-    setUnitId(&ptr[6], unitId);
-    setFunctionCode(&ptr[7], functionCode);
-    return id;
+    this->maxInFlightRequests = qMax(1, maxInFlightRequests);
+    pumpBulkTransfers();
 }
 
-void QModbusTcpClient::writeSingleWordFC6(quint16 wordAddress, quint16 wordValue)
+int QModbusTcpClient::getMaxInFlightRequests()
 {
-    char trame[12];
-    quint16 id = setHeader(trame, 6, unitId, 0x06);
-    trame[8] = getMSB(wordAddress);
-    trame[9] = getLSB(wordAddress);
-    trame[10] = getMSB(wordValue);
-    trame[11] = getLSB(wordValue);
-
-    pendingRequests[id] = new WriteSingleWordFC6Request(this, id, wordAddress, wordValue);
-    QByteArray data(trame, 12);
-    write(data);
-    flush();
+    return maxInFlightRequests;
 }
 
-void QModbusTcpClient::readMultipleHoldingRegistersFC3(quint16 startAddress, quint16 nbWord)
+quint32 QModbusTcpClient::readHoldingRegistersBulk(quint16 startAddress, quint32 count, quint16 *destination)
 {
-    char trame[12];
-    quint16 id = setHeader(trame, 6, unitId, 0x03);
-    trame[8] = getMSB(startAddress);
-    trame[9] = getLSB(startAddress);
-    trame[10] = getMSB(nbWord);
-    trame[11] = getLSB(nbWord);
-
-    pendingRequests[id] = new ReadMultipleHoldingRegistersFC3Request(this, id, startAddress, nbWord);
-    QByteArray data(trame, 12);
-    write(data);
-    flush();
+    return startBulkTransfer(0x03, startAddress, count, destination, nullptr, nullptr);
 }
 
-void QModbusTcpClient::readMultipleInputRegistersFC4(quint16 startAddress, quint16 nbWord)
+quint32 QModbusTcpClient::readInputRegistersBulk(quint16 startAddress, quint32 count, quint16 *destination)
 {
-    char trame[12];
-    quint16 id = setHeader(trame, 6, unitId, 0x04);
-    trame[8] = getMSB(startAddress);
-    trame[9] = getLSB(startAddress);
-    trame[10] = getMSB(nbWord);
-    trame[11] = getLSB(nbWord);
-
-    pendingRequests[id] = new ReadMultipleInputRegistersFC4Request(this, id, startAddress, nbWord);
-    QByteArray data(trame, 12);
-    write(data);
-    flush();
+    return startBulkTransfer(0x04, startAddress, count, destination, nullptr, nullptr);
 }
 
-void QModbusTcpClient::forceSingleCoilFC5(quint16 coilAddress, bool value)
+quint32 QModbusTcpClient::presetRegistersBulk(quint16 startAddress, const quint16 *values, quint32 count)
 {
-    char trame[12];
-    quint16 id = setHeader(trame, 6, unitId, 0x05);
-    trame[8] = getMSB(coilAddress);
-    trame[9] = getLSB(coilAddress);
-    trame[10] = value ? 0xFF : 0x00;
-    trame[11] = 0x00;
+    return startBulkTransfer(0x10, startAddress, count, nullptr, values, nullptr);
+}
 
-    pendingRequests[id] = new ForceSingleCoilsFC5Request(this, id, coilAddress, value);
-    QByteArray data(trame, 12);
-    write(data);
-    flush();
+quint32 QModbusTcpClient::forceCoilsBulk(quint16 startAddress, const bool *values, quint32 count)
+{
+    return startBulkTransfer(0x0F, startAddress, count, nullptr, nullptr, values);
 }
 
-void QModbusTcpClient::forceMultipleCoilsFC15(quint16 startAddress, QVector<bool> values)
+quint32 QModbusTcpClient::startBulkTransfer(quint8 functionCode, quint16 startAddress, quint32 count, quint16 *destination, const quint16 *registers, const bool *coils)
 {
-    quint32 nbByteToCode = qCeil((qreal)values.size() / (qreal)8.0);
-    if(nbByteToCode > 255)
+    if(count == 0 || (quint32)startAddress + count > 0x10000 || (destination == nullptr && registers == nullptr && coils == nullptr))
     {
-        qDebug() << "QModbusTcpClient::forceMultipleCoilsFC15 - There is too much values to write ... Operation aborted.";
+        qDebug() << "QModbusTcpClient::startBulkTransfer - Invalid range or buffer ... Operation aborted.";
+        return 0;
     }
-    else {
-        quint16 nbValues = values.size();
-        quint16 length = 13 + nbByteToCode;
-        char * trame = new char[length];
-        quint16 id = setHeader(trame, length - 6, unitId, 0x0F);
-        trame[8] = getMSB(startAddress);
-        trame[9] = getLSB(startAddress);
-        trame[10] = getMSB(nbValues);
-        trame[11] = getLSB(nbValues);
-        trame[12] = nbByteToCode;
-
-        int byteIdxToCode = 13;
-        trame[byteIdxToCode] = 0;
-        for(int i = 0; i < nbValues; i++)
-        {
-            if(i != 0 && i % 8 == 0)
-            {
-                byteIdxToCode++;
-                trame[byteIdxToCode] = 0;
-            }
-
-            setBit(&trame[byteIdxToCode], i % 8, values[i]);
-        }
 
-        pendingRequests[id] = new ForceMultipleCoilsFC15Request(this, id, startAddress, values);
-        QByteArray data(trame, length);
-        write(data);
-        flush();
-        delete trame;
+    BulkTransfer transfer;
+    transfer.id = nextBulkTransferId++;
+    if(nextBulkTransferId == 0)
+    {
+        nextBulkTransferId = 1;
     }
+    transfer.functionCode = functionCode;
+    transfer.startAddress = startAddress;
+    transfer.count = count;
+    transfer.destination = destination;
+    transfer.registers = registers;
+    transfer.coils = coils;
+    transfer.nextOffset = 0;
+    transfer.inFlight = 0;
+    transfer.failed = false;
+
+    bulkTransfers[transfer.id] = transfer;
+    pumpBulkTransfers();
+    return transfer.id;
 }
 
-void QModbusTcpClient::readMultipleInputsStatusFC2(quint16 startAddress, quint16 nbInput)
+void QModbusTcpClient::pumpBulkTransfers()
 {
-    char trame[12];
-    quint16 id = setHeader(trame, 6, unitId, 0x02);
-    trame[8] = getMSB(startAddress);
-    trame[9] = getLSB(startAddress);
-    trame[10] = getMSB(nbInput);
-    trame[11] = getLSB(nbInput);
-
-    pendingRequests[id] = new ReadMultipleInputsStatusFC2Request(this, id, startAddress, nbInput);
-    QByteArray data(trame, 12);
-    write(data);
-    flush();
+    // Oldest transfers first, so a transfer isn't delayed by the ones started after it :
+    QMap<quint32, BulkTransfer>::iterator it;
+    // Every pending request counts against the limit, not only the bulk chunks :
+    for(it = bulkTransfers.begin(); it != bulkTransfers.end() && pendingRequests.size() < maxInFlightRequests; ++it)
+    {
+        BulkTransfer & transfer = it.value();
+        while(pendingRequests.size() < maxInFlightRequests && !transfer.failed && transfer.nextOffset < transfer.count)
+        {
+            sendBulkChunk(transfer);
+        }
+    }
 }
 
-void QModbusTcpClient::presetMultipleRegistersFC16(quint16 startAddress, QVector<quint16> values)
+void QModbusTcpClient::sendBulkChunk(BulkTransfer &transfer)
 {
-    if(values.size() > 255)
+    quint16 chunkCount = qMin<quint32>(transfer.count - transfer.nextOffset, getBulkChunkSize(transfer.functionCode));
+    quint16 chunkAddress = transfer.startAddress + transfer.nextOffset;
+    quint16 * destination = nullptr;
+    quint16 id = nextTransactionId();
+    QByteArray frame;
+
+    if(transfer.functionCode == 0x10)
+    {
+        // Values are encoded straight from the caller buffer :
+        frame = QByteArray(ModbusFrame::getPresetMultipleRegistersSize(chunkCount), '\0');
+        ModbusFrame::encodePresetMultipleRegisters(frame.data(), id, unitId, chunkAddress, transfer.registers + transfer.nextOffset, chunkCount);
+    }
+    else if(transfer.functionCode == 0x0F)
     {
-        qDebug() << "QModbusTcpClient::presetMultipleRegistersFC16 - There is too much values to write ... Operation aborted.";
+        frame = QByteArray(ModbusFrame::getForceMultipleCoilsSize(chunkCount), '\0');
+        ModbusFrame::encodeForceMultipleCoils(frame.data(), id, unitId, chunkAddress, transfer.coils + transfer.nextOffset, chunkCount);
     }
     else
     {
-        quint16 length = 13 + 2 * values.size();
-        char * trame = new char[13 + 2 * values.size()];
-        quint16 id = setHeader(trame, length - 6, unitId, 0x10);
-        trame[8] = getMSB(startAddress);
-        trame[9] = getLSB(startAddress);
-        trame[10] = getMSB(values.size());
-        trame[11] = getLSB(values.size());
-        trame[12] = values.size();
+        destination = transfer.destination + transfer.nextOffset;
+        frame = QByteArray(SINGLE_REQUEST_SIZE, '\0');
+        ModbusFrame::encodeRequest(frame.data(), id, unitId, transfer.functionCode, chunkAddress, chunkCount);
+    }
 
-        for(int i = 0; i < values.size(); i++)
+    transfer.nextOffset += chunkCount;
+    transfer.inFlight++;
+
+    sendRequest(new BulkChunkRequest(this, id, transfer.functionCode, transfer.id, chunkAddress, chunkCount, destination), frame);
+}
+
+void QModbusTcpClient::onBulkChunkFinished(quint32 transferId, bool success)
+{
+    QMap<quint32, BulkTransfer>::iterator it = bulkTransfers.find(transferId);
+    if(it != bulkTransfers.end())
+    {
+        BulkTransfer & transfer = it.value();
+        transfer.inFlight--;
+        if(!success)
         {
-            int currentIdx = 13 + (2 * i);
-            trame[currentIdx] = getMSB(values[i]);
-            trame[currentIdx + 1] = getLSB(values[i]);
+            transfer.failed = true;
         }
 
-        pendingRequests[id] = new PresetMultipleRegisterFC16Request(this, id, startAddress, values);
-        QByteArray data(trame, 12);
-        write(data);
-        flush();
-        delete trame;
+        if(transfer.inFlight == 0 && (transfer.failed || transfer.nextOffset >= transfer.count))
+        {
+            bool transferSuccess = !transfer.failed;
+            bulkTransfers.erase(it);
+            emit onBulkTransferFinished(transferId, transferSuccess);
+        }
     }
+
+    pumpBulkTransfers();
 }
@@ -4,7 +4,11 @@
 #include <QObject>
 #include <QTcpSocket>
 #include <QMap>
+#include <QHash>
 #include <QVector>
+#include <QStringList>
+#include <QTimer>
+#include <QElapsedTimer>
 
 class QModbusTcpClient;
 
@@ -13,6 +17,12 @@ class ModbusRequest
     QModbusTcpClient * client;
     quint16 transactionId;
 
+    // Encoded sentence, kept so the request can be replayed after a reconnect :
+    QByteArray frame;
+    bool sent;
+    QElapsedTimer sentTimer;
+    QElapsedTimer ageTimer;
+
 protected:
     QModbusTcpClient * getClient() {
         return client;
@@ -22,8 +32,25 @@ public:
     ModbusRequest(QModbusTcpClient * client, quint16 transactionId);
     virtual ~ModbusRequest();
     quint16 getTransactionId();
+    QByteArray getFrame();
+    void setFrame(QByteArray frame);
+    bool isSent();
+    void setSent(bool sent);
+    qint64 getTimeSinceSent();
+    qint64 getAge();
     virtual quint8 getFunctionCode() = 0;
-    virtual void decodeAndCallback(QVector<unsigned char> extractedData) = 0;
+    virtual quint16 getAddress() = 0;
+    // The sentence (MBAP header included) lives in the receive buffer, it is only valid until the first signal is emitted :
+    virtual void decodeAndCallback(const unsigned char * sentence, int length) = 0;
+
+    // Called when the request is dropped without response (connection lost, client destroyed ...) :
+    virtual void abortAndCallback();
+
+    // Called when the device answered with an exception response (function code | 0x80) :
+    virtual void exceptionAndCallback(quint8 exceptionCode);
+
+    // Called when the request is dropped by QModbusTcpClient::cancelRequest, the caller already knows :
+    virtual void cancelAndCallback();
 };
 
 
@@ -40,7 +67,11 @@ public:
         return 0x06;
     }
 
-    virtual void decodeAndCallback(QVector<unsigned char> extractedData);
+    virtual quint16 getAddress() {
+        return wordAddress;
+    }
+
+    virtual void decodeAndCallback(const unsigned char * sentence, int length);
 
     virtual ~WriteSingleWordFC6Request();
 };
@@ -57,7 +88,11 @@ public:
         return 0x03;
     }
 
-    virtual void decodeAndCallback(QVector<unsigned char> extractedData);
+    virtual quint16 getAddress() {
+        return startAddress;
+    }
+
+    virtual void decodeAndCallback(const unsigned char * sentence, int length);
 
     virtual ~ReadMultipleHoldingRegistersFC3Request();
 };
@@ -74,7 +109,11 @@ public:
         return 0x04;
     }
 
-    virtual void decodeAndCallback(QVector<unsigned char> extractedData);
+    virtual quint16 getAddress() {
+        return startAddress;
+    }
+
+    virtual void decodeAndCallback(const unsigned char * sentence, int length);
 
     virtual ~ReadMultipleInputRegistersFC4Request();
 };
@@ -91,7 +130,11 @@ public:
         return 0x05;
     }
 
-    virtual void decodeAndCallback(QVector<unsigned char> extractedData);
+    virtual quint16 getAddress() {
+        return coilAddress;
+    }
+
+    virtual void decodeAndCallback(const unsigned char * sentence, int length);
 
     virtual ~ForceSingleCoilsFC5Request();
 };
@@ -108,7 +151,11 @@ public:
         return 0x0F;
     }
 
-    virtual void decodeAndCallback(QVector<unsigned char> extractedData);
+    virtual quint16 getAddress() {
+        return startAddress;
+    }
+
+    virtual void decodeAndCallback(const unsigned char * sentence, int length);
 
     virtual ~ForceMultipleCoilsFC15Request();
 };
@@ -125,7 +172,11 @@ public:
         return 0x02;
     }
 
-    virtual void decodeAndCallback(QVector<unsigned char> extractedData);
+    virtual quint16 getAddress() {
+        return startAddress;
+    }
+
+    virtual void decodeAndCallback(const unsigned char * sentence, int length);
 
     virtual ~ReadMultipleInputsStatusFC2Request();
 };
@@ -142,53 +193,254 @@ public:
         return 0x10;
     }
 
-    virtual void decodeAndCallback(QVector<unsigned char> extractedData);
+    virtual quint16 getAddress() {
+        return startAddress;
+    }
+
+    virtual void decodeAndCallback(const unsigned char * sentence, int length);
 
     virtual ~PresetMultipleRegisterFC16Request();
 };
 
+// One spec-maximal chunk of a bulk transfer (FC3, FC4, FC15 or FC16) :
+class BulkChunkRequest : public ModbusRequest
+{
+    quint8 functionCode;
+    quint32 transferId;
+    quint16 startAddress;
+    quint16 count;
+    quint16 * destination; // Read chunks only, decoded in place
+
+public:
+    BulkChunkRequest(QModbusTcpClient * client, quint16 transactionId, quint8 functionCode, quint32 transferId, quint16 startAddress, quint16 count, quint16 * destination);
+
+    virtual quint8 getFunctionCode() {
+        return functionCode;
+    }
+
+    virtual quint16 getAddress() {
+        return startAddress;
+    }
+
+    virtual void decodeAndCallback(const unsigned char * sentence, int length);
+    virtual void abortAndCallback();
+    virtual void exceptionAndCallback(quint8 exceptionCode);
+    virtual void cancelAndCallback();
+
+    virtual ~BulkChunkRequest();
+};
+
 
 class QModbusTcpClient : public QTcpSocket
 {
     Q_OBJECT
 
+public:
+    // What happens to requests still waiting for a response when the connection is lost :
+    enum PendingRequestPolicy {
+        ReplayPendingRequests,  // Kept and sent again (same transaction id) once reconnected
+        AbortPendingRequests    // Completed immediately through onRequestAborted
+    };
+    Q_ENUM(PendingRequestPolicy)
+
+    // Exception codes of a Modbus exception response :
+    enum ExceptionCode {
+        UnknownException = 0x00,
+        IllegalFunction = 0x01,
+        IllegalDataAddress = 0x02,
+        IllegalDataValue = 0x03,
+        SlaveDeviceFailure = 0x04,
+        Acknowledge = 0x05,
+        SlaveDeviceBusy = 0x06,
+        NegativeAcknowledge = 0x07,
+        MemoryParityError = 0x08,
+        GatewayPathUnavailable = 0x0A,
+        GatewayTargetFailedToRespond = 0x0B
+    };
+    Q_ENUM(ExceptionCode)
+
+private:
+    struct BulkTransfer
+    {
+        quint32 id;
+        quint8 functionCode;
+        quint16 startAddress;
+        quint32 count;
+        quint16 * destination;
+        const quint16 * registers;
+        const bool * coils;
+        quint32 nextOffset;
+        int inFlight;
+        bool failed;
+    };
+
     QString host;
+    QStringList redundantHosts;
+    QString activeHost;
     quint16 port;
     quint8 unitId;
 
     quint16 transactionId;
+    quint16 respondingTransactionId;
 
     QVector<char> buffer;
+    bool processingSentences; // Set while sentences are decoded in place from the buffer
+    bool bufferReset;         // Set when the buffer is cleared by a connection loss
     QMap<quint16, ModbusRequest*> pendingRequests;
 
-    friend class ReadMultipleInputsStatusFC2Request;
-    static bool getBit(char byte, int bitNumber);
-    static void setBit(char * byte, int bitNumber, bool value);
-    static char getMSB(quint16);
-    static char getLSB(quint16);
-    quint16 setTransactionId(char * ptr);
-    static void setProtocolId(char * ptr);
-    static void setLength(char * ptr, quint16 len);
-    static void setUnitId(char * ptr, quint8 unitId);
-    static void setFunctionCode(char * ptr, quint8 functionCode);
-
-    // Return the transactionId
-    quint16 setHeader(char * ptr, quint16 length, quint8 unitId, quint8 functionCode);
+    // Last known register values, kept across reconnections :
+    QHash<quint16, quint16> holdingRegistersCache;
+    QHash<quint16, quint16> inputRegistersCache;
+
+    // Reconnect supervisor :
+    bool autoReconnect;
+    bool userDisconnected;
+    bool wasConnected;
+    PendingRequestPolicy pendingRequestPolicy;
+    int reconnectInitialDelay;
+    int reconnectMaxDelay;
+    int connectTimeout;
+    int responseTimeout;
+    int maxRequestAge;
+    int reconnectAttempt;
+    QTimer reconnectTimer;
+    QTimer connectTimer;
+    QTimer responseTimer;
+    QList<QTcpSocket*> probes;
+
+    // Metrics :
+    QElapsedTimer disconnectTimer;
+    QElapsedTimer lastDataTimer;
+    bool dataGapPending;
+    qint64 lastReconnectTime;
+    qint64 lastDataGap;
+    quint32 reconnectCount;
+
+    // Exceptions :
+    quint32 exceptionCounters[GatewayTargetFailedToRespond + 1];
+    int exceptionBackoffInitialDelay;
+    int exceptionBackoffMaxDelay;
+    int exceptionBackoffStep;
+    QTimer sendHoldTimer;
+
+    // Bulk transfers :
+    QMap<quint32, BulkTransfer> bulkTransfers;
+    quint32 nextBulkTransferId;
+    int maxInFlightRequests;
+
+    friend class ReadMultipleHoldingRegistersFC3Request;
+    friend class ReadMultipleInputRegistersFC4Request;
+    friend class BulkChunkRequest;
+
+    // Frames are encoded by ModbusFrame, return the transactionId of the next request (ids still pending are skipped) :
+    quint16 nextTransactionId();
 
     void processModbusSentence();
 
+    // Register the request as pending and send it as soon as the socket is connected :
+    void sendRequest(ModbusRequest * request, QByteArray frame);
+    void writeRequest(ModbusRequest * request);
+    void sendUnsentRequests();
+    void abortExpiredRequests();
+    void startResponseTimer();
+    void abortPendingRequests();
+
+    void startConnectAttempt();
+    void scheduleReconnect();
+    void clearProbes();
+    void onConnectionEstablished();
+    void onConnectionLost();
+
+    void onExceptionReceived(quint8 exceptionCode);
+
+    quint32 startBulkTransfer(quint8 functionCode, quint16 startAddress, quint32 count, quint16 * destination, const quint16 * registers, const bool * coils);
+    void sendBulkChunk(BulkTransfer & transfer);
+    void pumpBulkTransfers();
+    void onBulkChunkFinished(quint32 transferId, bool success);
+    static quint16 getBulkChunkSize(quint8 functionCode);
+
+    void updateHoldingRegisterCache(quint16 address, quint16 value);
+    void updateInputRegisterCache(quint16 address, quint16 value);
+
 public:
     explicit QModbusTcpClient(QString host, quint16 port, QObject *parent = nullptr);
+    virtual ~QModbusTcpClient();
     virtual void connectToHost();
-    void writeSingleWordFC6(quint16 wordAddress, quint16 wordValue);
-    void readMultipleHoldingRegistersFC3(quint16 startAddress, quint16 nbWord);
-    void readMultipleInputRegistersFC4(quint16 startAddress, quint16 nbWord);
-    void forceSingleCoilFC5(quint16 coilAddress, bool value);
-    void forceMultipleCoilsFC15(quint16 startAddress, QVector<bool> values);
-
-    void readMultipleInputsStatusFC2(quint16 startAddress, quint16 nbInput);
-
-    void presetMultipleRegistersFC16(quint16 startAddress, QVector<quint16> values);
+    virtual void disconnectFromHost();
+
+    // Other addresses of the same device, tried in parallel with the primary host on each (re)connection.
+    // On Unix the first connection accepted becomes the client transport, other platforms reconnect to its address :
+    void addRedundantHost(QString host);
+    QString getActiveHost();
+
+    void setAutoReconnect(bool enabled);
+    // Jittered exponential backoff : the first retry is immediate, then
+    // each delay is drawn in [ceiling / 2, ceiling] with ceiling doubling up to maxDelayMs.
+    void setReconnectBackoff(int initialDelayMs, int maxDelayMs);
+    // Timeout of a single connection attempt when auto reconnect is enabled, 0 disables it.
+    void setConnectTimeout(int timeoutMs);
+    // Time allowed for a response when auto reconnect is enabled, 0 disables it. A link lost without
+    // FIN or RST leaves the socket connected, so a late response aborts the connection and reconnects.
+    void setResponseTimeout(int timeoutMs);
+    void setPendingRequestPolicy(PendingRequestPolicy policy);
+    // Requests waiting for the connection (or the end of a send hold) longer than maxAgeMs are aborted
+    // through onRequestAborted instead of being sent late, 0 keeps them until sent.
+    void setMaxRequestAge(int maxAgeMs);
+
+    bool getCachedHoldingRegister(quint16 address, quint16 * value);
+    bool getCachedInputRegister(quint16 address, quint16 * value);
+    void clearRegisterCache();
+
+    // Time between the connection loss and the next successful connection (ms) :
+    qint64 getLastReconnectTime();
+    // Time between the last data received before the connection loss and the first data received after (ms) :
+    qint64 getLastDataGap();
+    quint32 getReconnectCount();
+
+    static ExceptionCode toExceptionCode(quint8 exceptionCode);
+
+    // Backoff policy, shared with QModbusCompactFleet :
+    // Delay before the given reconnect attempt, 0 for the first one, then drawn in [ceiling / 2, ceiling] with ceiling doubling up to maxDelayMs.
+    static int getReconnectDelay(int initialDelayMs, int maxDelayMs, int attempt);
+    // Send hold after the given consecutive busy or gateway exception (0 for the first one), doubling up to maxDelayMs.
+    static int getExceptionHoldDelay(int initialDelayMs, int maxDelayMs, int step);
+    // Busy and gateway exceptions hold the sends, the other ones don't :
+    static bool isSendHoldException(ExceptionCode exceptionCode);
+    quint32 getExceptionCount(ExceptionCode exceptionCode);
+    bool isHoldingSends();
+    void resetExceptionCounters();
+    // Sending is held for a growing delay after a busy or gateway exception, reset on the next normal response :
+    void setExceptionBackoff(int initialDelayMs, int maxDelayMs);
+
+    // Request calls return the transaction id of the request, 0 if it was rejected :
+    quint16 writeSingleWordFC6(quint16 wordAddress, quint16 wordValue);
+    quint16 readMultipleHoldingRegistersFC3(quint16 startAddress, quint16 nbWord);
+    quint16 readMultipleInputRegistersFC4(quint16 startAddress, quint16 nbWord);
+    quint16 forceSingleCoilFC5(quint16 coilAddress, bool value);
+    quint16 forceMultipleCoilsFC15(quint16 startAddress, QVector<bool> values);
+
+    quint16 readMultipleInputsStatusFC2(quint16 startAddress, quint16 nbInput);
+
+    quint16 presetMultipleRegistersFC16(quint16 startAddress, QVector<quint16> values);
+
+    // Drop a pending request without callback, a late response to it is ignored.
+    // Cancelling a chunk of a bulk transfer fails the whole transfer :
+    bool cancelRequest(quint16 transactionId);
+    // Transaction id of the response being dispatched, valid inside the response signals only :
+    quint16 getRespondingTransactionId();
+
+    // Bulk transfers of any length : split into spec-maximal requests, with a single onBulkTransferFinished.
+    // A chunk is only sent while fewer than getMaxInFlightRequests() requests of any kind are pending.
+    // Read values are decoded in place into destination. A chunk answered by an exception is also reported
+    // through onModbusException, with the transaction id and start address of the chunk.
+    // Buffers must stay valid until the transfer finishes. Return the transfer id, 0 if the range is invalid.
+    quint32 readHoldingRegistersBulk(quint16 startAddress, quint32 count, quint16 * destination);
+    quint32 readInputRegistersBulk(quint16 startAddress, quint32 count, quint16 * destination);
+    quint32 presetRegistersBulk(quint16 startAddress, const quint16 * values, quint32 count);
+    quint32 forceCoilsBulk(quint16 startAddress, const bool * values, quint32 count);
+
+    void setMaxInFlightRequests(int maxInFlightRequests);
+    int getMaxInFlightRequests();
 
 signals:
     // FC 06 (0x06)
@@ -214,9 +466,36 @@ signals:
     // FC 16 (0x10)
     void onPresetMultipleRegistersSentence(bool writeSuccess, quint16 startAddress, QVector<quint16> valuesWriteRequested, quint16 nbValueWritten);
 
+    // Bulk transfers :
+    void onBulkTransferFinished(quint32 transferId, bool success);
+
+    // Request written to the socket (again after a reconnect when replayed) :
+    void onRequestSent(quint16 transactionId);
+
+    // Request dropped without response :
+    void onRequestAborted(quint16 transactionId, quint8 functionCode, quint16 address);
+
+    // Request completed by an exception response :
+    void onModbusException(quint16 transactionId, quint8 functionCode, quint16 address, QModbusTcpClient::ExceptionCode exceptionCode);
+    // Sending held after a busy or gateway exception, requests issued meanwhile wait for the end of the hold :
+    void onSendHold(int delayMs);
+
+    // Reconnect supervisor :
+    void onReconnected(qint64 reconnectTimeMs);
+    void onDataGap(qint64 dataGapMs);
+
 public slots:
     void onDataRecv();
 
+private slots:
+    void onSocketStateChanged(QAbstractSocket::SocketState state);
+    void onReconnectTimeout();
+    void onConnectTimeout();
+    void onResponseTimeout();
+    void onProbeConnected();
+    void onProbeStateChanged(QAbstractSocket::SocketState state);
+    void onSendHoldTimeout();
+
 };
 
 #endif // QModbusTcpClient_H
@@ -0,0 +1,287 @@
+// Report the resident memory used per idle and per active connection by QModbusTcpClient
+// and by QModbusCompactFleet. "Active" is the peak sampled while the responses are being
+// received, i.e. while the connections own their receive buffers. A forked local server
+// accepts every connection and answers FC3 / FC4 reads with zeros, so the server side isn't
+// accounted in the measure.
+// Linux only (reads /proc/self/statm).
+//
+// Usage : memorybench [full|compact] [nbConnections]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QVector>
+#include "qmodbustcpclient.h"
+#include "qmodbuscompactfleet.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <vector>
+
+#define WAIT_TIMEOUT_MS 30000
+
+static qint64 residentMemory()
+{
+    long size = 0;
+    long resident = 0;
+    FILE * statm = fopen("/proc/self/statm", "r");
+    if(statm != nullptr)
+    {
+        if(fscanf(statm, "%ld %ld", &size, &resident) != 2)
+        {
+            resident = 0;
+        }
+        fclose(statm);
+    }
+    return (qint64)resident * sysconf(_SC_PAGESIZE);
+}
+
+static void raiseFileLimit()
+{
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static int runServer(int listenFd)
+{
+    std::vector<struct pollfd> fds;
+    struct pollfd listenPoll = { listenFd, POLLIN, 0 };
+    fds.push_back(listenPoll);
+
+    while(true)
+    {
+        if(poll(fds.data(), fds.size(), -1) < 0)
+        {
+            continue;
+        }
+
+        size_t nbFds = fds.size();
+        for(size_t i = 1; i < nbFds; i++)
+        {
+            if((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+            {
+                continue;
+            }
+
+            unsigned char request[12];
+            if(recv(fds[i].fd, request, sizeof(request), MSG_WAITALL) != (ssize_t)sizeof(request))
+            {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                continue;
+            }
+
+            unsigned char response[260];
+            int length = 12;
+            memcpy(response, request, 8);
+            if(request[7] == 0x03 || request[7] == 0x04)
+            {
+                int nbWord = qMin((request[10] << 8) | request[11], 125);
+                response[4] = 0;
+                response[5] = 3 + 2 * nbWord;
+                response[8] = 2 * nbWord;
+                memset(&response[9], 0, 2 * nbWord);
+                length = 9 + 2 * nbWord;
+            }
+            else
+            {
+                memcpy(response, request, sizeof(request));
+            }
+            send(fds[i].fd, response, length, MSG_NOSIGNAL);
+        }
+
+        if(fds[0].revents & POLLIN)
+        {
+            int clientFd = accept(listenFd, nullptr, nullptr);
+            if(clientFd >= 0)
+            {
+                struct pollfd clientPoll = { clientFd, POLLIN, 0 };
+                fds.push_back(clientPoll);
+            }
+        }
+
+        std::vector<struct pollfd> openFds;
+        for(size_t i = 0; i < fds.size(); i++)
+        {
+            if(fds[i].fd >= 0)
+            {
+                openFds.push_back(fds[i]);
+            }
+        }
+        fds.swap(openFds);
+    }
+
+    return 0;
+}
+
+static void printPerConnection(const char * label, qint64 bytes, int nbConnections)
+{
+    printf("%-40s %10.1f bytes\n", label, (double)bytes / nbConnections);
+}
+
+static bool waitFor(int * counter, int target)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while(*counter < target && timer.elapsed() < WAIT_TIMEOUT_MS)
+    {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 50);
+    }
+    return *counter >= target;
+}
+
+static int benchFull(int nbConnections, quint16 port, qint64 baseline)
+{
+    QVector<QModbusTcpClient*> clients;
+    int connected = 0;
+    int responses = 0;
+    qint64 activePeak = 0;
+
+    for(int i = 0; i < nbConnections; i++)
+    {
+        QModbusTcpClient * client = new QModbusTcpClient("127.0.0.1", port);
+        QObject::connect(client, &QModbusTcpClient::connected, [&connected]() { connected++; });
+        QObject::connect(client, &QModbusTcpClient::onReadMultipleHoldingRegistersSentence, [&](quint16, QVector<quint16>) {
+            responses++;
+            activePeak = qMax(activePeak, residentMemory());
+        });
+        client->connectToHost();
+        clients.push_back(client);
+    }
+
+    if(!waitFor(&connected, nbConnections))
+    {
+        fprintf(stderr, "Only %d / %d connections established\n", connected, nbConnections);
+        return 1;
+    }
+    qint64 idle = residentMemory();
+
+    for(int i = 0; i < nbConnections; i++)
+    {
+        clients[i]->readMultipleHoldingRegistersFC3(0, 125);
+    }
+    qint64 inFlight = residentMemory();
+
+    if(!waitFor(&responses, nbConnections))
+    {
+        fprintf(stderr, "Only %d / %d responses received\n", responses, nbConnections);
+        return 1;
+    }
+    qint64 afterTraffic = residentMemory();
+
+    printf("QModbusTcpClient, %d connections\n", nbConnections);
+    printPerConnection("Idle connection :", idle - baseline, nbConnections);
+    printPerConnection("Request in flight :", inFlight - baseline, nbConnections);
+    printPerConnection("Active connection (receiving, peak) :", activePeak - baseline, nbConnections);
+    printPerConnection("Idle connection after traffic :", afterTraffic - baseline, nbConnections);
+
+    qDeleteAll(clients);
+    return 0;
+}
+
+static int benchCompact(int nbConnections, quint16 port, qint64 baseline)
+{
+    QModbusCompactFleet fleet;
+    int connected = 0;
+    int responses = 0;
+    int maxBorrowedBuffers = 0;
+    qint64 activePeak = 0;
+
+    QObject::connect(&fleet, &QModbusCompactFleet::onDeviceConnected, [&connected](int) { connected++; });
+    QObject::connect(&fleet, &QModbusCompactFleet::onReadMultipleHoldingRegistersSentence, [&](int, quint16, QVector<quint16>) {
+        responses++;
+        maxBorrowedBuffers = qMax(maxBorrowedBuffers, fleet.getBorrowedBufferCount());
+        activePeak = qMax(activePeak, residentMemory());
+    });
+
+    for(int i = 0; i < nbConnections; i++)
+    {
+        int device = fleet.addDevice(QHostAddress(QHostAddress::LocalHost), port);
+        fleet.connectDevice(device);
+    }
+
+    if(!waitFor(&connected, nbConnections))
+    {
+        fprintf(stderr, "Only %d / %d connections established\n", connected, nbConnections);
+        return 1;
+    }
+    qint64 idle = residentMemory();
+
+    for(int i = 0; i < nbConnections; i++)
+    {
+        fleet.readMultipleHoldingRegistersFC3(i, 0, 125);
+    }
+    qint64 inFlight = residentMemory();
+
+    if(!waitFor(&responses, nbConnections))
+    {
+        fprintf(stderr, "Only %d / %d responses received\n", responses, nbConnections);
+        return 1;
+    }
+    qint64 afterTraffic = residentMemory();
+
+    printf("QModbusCompactFleet, %d connections (%d bytes of state per device)\n", nbConnections, QModbusCompactFleet::getDeviceStateSize());
+    printPerConnection("Idle connection :", idle - baseline, nbConnections);
+    printPerConnection("Request in flight :", inFlight - baseline, nbConnections);
+    printPerConnection("Active connection (receiving, peak) :", activePeak - baseline, nbConnections);
+    printPerConnection("Idle connection after traffic :", afterTraffic - baseline, nbConnections);
+    printf("%-40s %10d bytes (%d buffers)\n", "Borrowed receive buffers (peak) :", maxBorrowedBuffers * COMPACT_BUFFER_SIZE, maxBorrowedBuffers);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    bool compact = !(argc > 1 && strcmp(argv[1], "full") == 0);
+    int nbConnections = (argc > 2) ? atoi(argv[2]) : 1000;
+    if(nbConnections <= 0)
+    {
+        fprintf(stderr, "Usage : %s [full|compact] [nbConnections]\n", argv[0]);
+        return 1;
+    }
+
+    raiseFileLimit();
+
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    if(bind(listenFd, (struct sockaddr *)&address, sizeof(address)) != 0
+            || listen(listenFd, SOMAXCONN) != 0
+            || getsockname(listenFd, (struct sockaddr *)&address, &addressLength) != 0)
+    {
+        perror("Unable to start the local server");
+        return 1;
+    }
+    quint16 port = ntohs(address.sin_port);
+
+    // The server runs in its own process so its sockets don't weigh in the measure :
+    pid_t serverPid = fork();
+    if(serverPid == 0)
+    {
+        return runServer(listenFd);
+    }
+    close(listenFd);
+
+    QCoreApplication app(argc, argv);
+    qint64 baseline = residentMemory();
+
+    int result = compact ? benchCompact(nbConnections, port, baseline) : benchFull(nbConnections, port, baseline);
+
+    kill(serverPid, SIGTERM);
+    waitpid(serverPid, nullptr, 0);
+    return result;
+}
@@ -0,0 +1,20 @@
+QT -= gui
+QT += network
+
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+TARGET = memorybench
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../qmodbusframe.cpp \
+    ../../qmodbustcpclient.cpp \
+    ../../qmodbuscompactfleet.cpp
+
+HEADERS += \
+    ../../qmodbusframe.h \
+    ../../qmodbustcpclient.h \
+    ../../qmodbuscompactfleet.h